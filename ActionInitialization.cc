@@ -3,6 +3,8 @@
 #include "RunAction.hh"
 #include "EventAction.hh"
 #include "SteppingAction.hh"
+#include "StackingAction.hh"
+#include "TrackingAction.hh"
 
 ActionInitialization::ActionInitialization()
  : G4VUserActionInitialization()
@@ -25,4 +27,8 @@ void ActionInitialization::Build() const
     SetUserAction(eventAction);
 
     SetUserAction(new SteppingAction(eventAction));
+
+    SetUserAction(new StackingAction(eventAction));
+
+    SetUserAction(new TrackingAction(eventAction));
 }
@@ -1,22 +1,132 @@
+import argparse
+import glob
+import os
+import shutil
+import tempfile
+import warnings
+from collections import deque
+from concurrent.futures import ProcessPoolExecutor
+
 import pandas as pd
+import pyarrow as pa
+import pyarrow.parquet as pq
 import uproot
-import warnings
 
 warnings.filterwarnings("ignore", category=DeprecationWarning)
 
-def process_fractional_energy(root_filename, output_csv="energy_maps_with_labels.csv"):
+TOTAL_CELLS = 64
+ALL_CELL_COLUMNS = [f'Cell_{i}' for i in range(TOTAL_CELLS)]
+FINAL_COLUMNS = ALL_CELL_COLUMNS + ['x_true', 'y_true']
+
+SPECTRUM_BRANCHES = ['EventID', 'CellID', 'ParticleName', 'EnergyMeV']
+MUON_BRANCHES = ['EventID', 'PreStepX_cm', 'PreStepY_cm']
+
+
+def _bucket_path(spill_dir, tree, bucket):
+    return os.path.join(spill_dir, tree, f'bucket_{bucket:08d}.parquet')
+
+
+class _Spill:
     """
-    Process ROOT file to extract the fractional energy deposited in the
-    first scintillator (cells 0-63) for each event.
-    The EventID is used for processing but is not saved in the output CSV.
+    Partial sums split by EventID bucket, so each bucket can be reduced on its own.
+    Rows are buffered per bucket across chunks and appended as row groups to one
+    Parquet file per (tree, bucket) once flush_rows are pending, or for all buckets
+    once max_buffered_rows are pending in total.
     """
+
+    def __init__(self, spill_dir, bucket_events, flush_rows=500000, max_buffered_rows=4000000):
+        self.spill_dir = spill_dir
+        self.bucket_events = bucket_events
+        self.flush_rows = flush_rows
+        self.max_buffered_rows = max_buffered_rows
+        self.buffers = {}
+        self.writers = {}
+        self.written = set()
+        self.buffered_rows = 0
+
+    def add(self, tree, df):
+        if df.empty:
+            return
+        for bucket, part in df.groupby(df['EventID'] // self.bucket_events):
+            key = (tree, int(bucket))
+            parts = self.buffers.setdefault(key, [])
+            parts.append(part)
+            self.buffered_rows += len(part)
+            if sum(len(pending) for pending in parts) >= self.flush_rows:
+                self._flush(key)
+        if self.buffered_rows >= self.max_buffered_rows:
+            for key in list(self.buffers):
+                self._flush(key)
+
+    def buckets(self, tree):
+        return sorted(bucket for name, bucket in self.written if name == tree)
+
+    def close(self):
+        for key in list(self.buffers):
+            self._flush(key)
+        for writer in self.writers.values():
+            writer.close()
+        self.writers.clear()
+
+    def _flush(self, key):
+        parts = self.buffers.pop(key, None)
+        if not parts:
+            return
+        self.buffered_rows -= sum(len(part) for part in parts)
+        table = pa.Table.from_pandas(pd.concat(parts, ignore_index=True), preserve_index=False)
+        writer = self.writers.get(key)
+        if writer is None:
+            tree, bucket = key
+            path = _bucket_path(self.spill_dir, tree, bucket)
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            writer = self.writers[key] = pq.ParquetWriter(path, table.schema)
+            self.written.add(key)
+        writer.write_table(table.cast(writer.schema))
+
+
+def _map_spectrum_chunk(root_filename, entry_start, entry_stop):
+    """Reduce one entry range of SpectrumData to photon energy per (EventID, CellID)."""
     with uproot.open(root_filename) as file:
-        spectrum_df = file['SpectrumData'].arrays(library="pd")
-        muon_df = file['MuonTrackData'].arrays(library="pd")
+        spectrum_df = file['SpectrumData'].arrays(SPECTRUM_BRANCHES, entry_start=entry_start,
+                                                  entry_stop=entry_stop, library="pd")
 
-    optical_photons = spectrum_df[spectrum_df['ParticleName'] == 'opticalphoton']
+    optical_photons = spectrum_df[(spectrum_df['ParticleName'] == 'opticalphoton') &
+                                  (spectrum_df['CellID'] < TOTAL_CELLS)]
     photon_energy = optical_photons.groupby(['EventID', 'CellID'])['EnergyMeV'].sum().reset_index()
-    photon_energy = photon_energy[photon_energy['CellID'] < 64].copy()
+    return 'spectrum', photon_energy
+
+
+def _map_muon_chunk(root_filename, entry_start, entry_stop):
+    """Reduce one entry range of MuonTrackData to position sums and step counts per EventID.
+    With pile-up only the first primary muon (PrimaryID 1) is the label."""
+    with uproot.open(root_filename) as file:
+        tree = file['MuonTrackData']
+        tagged = 'PrimaryID' in tree.keys()
+        muon_df = tree.arrays(MUON_BRANCHES + (['PrimaryID'] if tagged else []), entry_start=entry_start,
+                              entry_stop=entry_stop, library="pd")
+    if tagged:
+        muon_df = muon_df[muon_df['PrimaryID'] == 1]
+
+    grouped = muon_df.groupby('EventID')
+    muon_sums = grouped[['PreStepX_cm', 'PreStepY_cm']].sum()
+    muon_sums['NSteps'] = grouped.size()
+    return 'muon', muon_sums.reset_index()
+
+
+def _read_bucket(spill_dir, tree, bucket):
+    path = _bucket_path(spill_dir, tree, bucket)
+    if not os.path.isfile(path):
+        return None
+    return pd.read_parquet(path)
+
+
+def _reduce_bucket(bucket, spill_dir, parquet_dir):
+    """
+    Combine the partial sums of one EventID bucket. Events split across input chunks
+    or files (or interleaved by multi-threaded ntuple merging) are summed back together here.
+    """
+    photon_energy = _read_bucket(spill_dir, 'spectrum', bucket)
+    photon_energy = photon_energy.groupby(['EventID', 'CellID'])['EnergyMeV'].sum().reset_index()
 
     total_event_energy = photon_energy.groupby('EventID')['EnergyMeV'].transform('sum')
     photon_energy['FractionalEnergy'] = photon_energy['EnergyMeV'] / total_event_energy
@@ -28,31 +138,150 @@ def process_fractional_energy(root_filename, output_csv="energy_maps_with_labels
         fill_value=0.0
     )
     cell_energy_df.columns = [f'Cell_{int(col)}' for col in cell_energy_df.columns]
-    
-    muon_positions = muon_df.groupby('EventID')[['PreStepX_cm', 'PreStepY_cm']].mean()
-    muon_positions = muon_positions.rename(columns={'PreStepX_cm': 'x_true', 'PreStepY_cm': 'y_true'})
+
+    muon_sums = _read_bucket(spill_dir, 'muon', bucket)
+    if muon_sums is not None:
+        muon_sums = muon_sums.groupby('EventID').sum()
+        muon_positions = pd.DataFrame({
+            'x_true': muon_sums['PreStepX_cm'] / muon_sums['NSteps'],
+            'y_true': muon_sums['PreStepY_cm'] / muon_sums['NSteps'],
+        })
+    else:
+        muon_positions = pd.DataFrame(columns=['x_true', 'y_true'], dtype=float)
 
     output_df = cell_energy_df.join(muon_positions, how='left').fillna(0.0)
-    
-    total_cells = 64
-    all_cell_columns = [f'Cell_{i}' for i in range(total_cells)]
-    for col in all_cell_columns:
+
+    for col in ALL_CELL_COLUMNS:
         if col not in output_df:
             output_df[col] = 0.0
 
-    final_columns = all_cell_columns + ['x_true', 'y_true']
-    output_df = output_df[final_columns]
+    output_df = output_df[FINAL_COLUMNS]
+
+    if parquet_dir:
+        output_df.to_parquet(os.path.join(parquet_dir, f'part_{bucket:08d}.parquet'))
 
-    output_df.to_csv(output_csv, float_format='%.6f', index=False)
-    
-    print(f"Data saved to {output_csv}")
-    
     return output_df
 
+
+def _run_bounded(executor, tasks, max_in_flight):
+    """Submit (function, arguments) tasks keeping at most max_in_flight outstanding;
+    yield results in submission order."""
+    pending = deque()
+    for function, arguments in tasks:
+        pending.append(executor.submit(function, *arguments))
+        if len(pending) >= max_in_flight:
+            yield pending.popleft().result()
+    while pending:
+        yield pending.popleft().result()
+
+
+def _entry_ranges(tree, step_size):
+    """Entry ranges of at most step_size (a memory size like "100 MB", or a number of entries)."""
+    if isinstance(step_size, int):
+        entries_per_chunk = max(1, step_size)
+    else:
+        entries_per_chunk = max(1, tree.num_entries_for(step_size))
+    for entry_start in range(0, tree.num_entries, entries_per_chunk):
+        yield entry_start, min(entry_start + entries_per_chunk, tree.num_entries)
+
+
+def expand_inputs(patterns):
+    """Input ROOT files for the given paths or glob patterns, in order and without duplicates."""
+    root_filenames = []
+    for pattern in patterns:
+        matches = sorted(glob.glob(pattern)) if glob.has_magic(pattern) else [pattern]
+        if not matches:
+            raise FileNotFoundError(f"No input file matches {pattern}")
+        root_filenames += [name for name in matches if name not in root_filenames]
+    return root_filenames
+
+
+def process_fractional_energy(root_filenames, output_csv="energy_maps_with_labels.csv",
+                              parquet_dir=None, step_size="100 MB", workers=None,
+                              bucket_events=100000):
+    """
+    Process ROOT files to extract the fractional energy deposited in the
+    first scintillator (cells 0-63) for each event.
+    The EventID is used for processing but is not saved in the output CSV.
+
+    root_filenames is one file name or a list of them, e.g. the per-thread
+    tomography_output_t<N>.root files of one run; rows with the same EventID are
+    combined across files, so the files must not come from different runs.
+
+    The trees are read in bounded entry ranges (step_size) by parallel workers
+    and reduced to per-event partial sums, which are spilled to disk by EventID
+    bucket, one Parquet file per bucket written in row groups as the partial sums
+    accumulate. Each bucket (bucket_events consecutive EventIDs) is then finalized
+    independently, so peak memory depends on step_size and bucket_events only,
+    not on the file size. Alongside the CSV, each bucket is written as one
+    Parquet part in parquet_dir (default: <output_csv stem>_parquet); stale part_*.parquet
+    files there are removed first, other files are left alone.
+    """
+    if isinstance(root_filenames, (str, os.PathLike)):
+        root_filenames = [root_filenames]
+    workers = workers or os.cpu_count() or 1
+    max_in_flight = 2 * workers
+    if parquet_dir is None:
+        parquet_dir = os.path.splitext(output_csv)[0] + '_parquet'
+    # Only the parts of a previous conversion are replaced; anything else in the directory stays
+    os.makedirs(parquet_dir, exist_ok=True)
+    for stale_part in glob.glob(os.path.join(parquet_dir, 'part_*.parquet')):
+        os.remove(stale_part)
+
+    output_dir = os.path.dirname(os.path.abspath(output_csv))
+    spill_dir = tempfile.mkdtemp(prefix='convert_spill_', dir=output_dir)
+    try:
+        map_tasks = []
+        for root_filename in root_filenames:
+            with uproot.open(root_filename) as file:
+                map_tasks += [(_map_spectrum_chunk, (root_filename, start, stop))
+                              for start, stop in _entry_ranges(file['SpectrumData'], step_size)]
+                map_tasks += [(_map_muon_chunk, (root_filename, start, stop))
+                              for start, stop in _entry_ranges(file['MuonTrackData'], step_size)]
+
+        with ProcessPoolExecutor(max_workers=workers) as executor:
+            # Map: entry ranges -> partial sums, spilled per EventID bucket
+            spill = _Spill(spill_dir, bucket_events)
+            try:
+                for tree, partial_sums in _run_bounded(executor, map_tasks, max_in_flight):
+                    spill.add(tree, partial_sums)
+            finally:
+                spill.close()
+
+            # Reduce: buckets in EventID order, appended to the CSV as they complete
+            buckets = spill.buckets('spectrum')
+
+            n_events = 0
+            with open(output_csv, 'w', newline='') as csv_file:
+                header = True
+                reduce_tasks = [(_reduce_bucket, (bucket, spill_dir, parquet_dir)) for bucket in buckets]
+                for output_df in _run_bounded(executor, reduce_tasks, max_in_flight):
+                    output_df.to_csv(csv_file, float_format='%.6f', index=False, header=header)
+                    header = False
+                    n_events += len(output_df)
+
+                if header:
+                    pd.DataFrame(columns=FINAL_COLUMNS).to_csv(csv_file, index=False)
+    finally:
+        shutil.rmtree(spill_dir, ignore_errors=True)
+
+    print(f"Data saved to {output_csv} ({n_events} events, Parquet parts in {parquet_dir})")
+
+    return n_events
+
+
 # --- Usage Example ---
 if __name__ == "__main__":
-    root_file = "tomography_output.root"
-    df_without_eventid = process_fractional_energy(root_file)
+    parser = argparse.ArgumentParser(description="Convert tomography ROOT output to training data.")
+    parser.add_argument("root_files", nargs="*", default=["tomography_output.root"],
+                        help="ROOT files or glob patterns, e.g. 'tomography_output_t*.root'")
+    parser.add_argument("--output", default="energy_maps_with_labels.csv")
+    parser.add_argument("--parquet-dir", default=None)
+    parser.add_argument("--step-size", default="100 MB", help="uproot chunk size, e.g. '100 MB' or entries")
+    parser.add_argument("--workers", type=int, default=None)
+    parser.add_argument("--bucket-events", type=int, default=100000)
+    args = parser.parse_args()
 
-    print("\nDataFrame structure in memory (still has EventID as index):")
-    print(df_without_eventid.head())
\ No newline at end of file
+    step_size = int(args.step_size) if args.step_size.isdigit() else args.step_size
+    process_fractional_energy(expand_inputs(args.root_files), args.output, args.parquet_dir, step_size,
+                              args.workers, args.bucket_events)
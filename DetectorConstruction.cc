@@ -34,7 +34,7 @@ DetectorConstruction::DetectorConstruction()
    fPVTMaterial(nullptr),
    scintillatorSizeXY_FullPlane(50.0*cm), // Initialize here or in DefineVolumes
    scintillatorThickness(2.0*cm),       // Initialize here or in DefineVolumes
-   nCellsPerSide(8),                     // Initialize here or in DefineVolumes
+   nCellsPerSide(kNofCellsPerSide),      // Initialize here or in DefineVolumes
    cellWidth(0.), // Will be calculated
    cellDepth(0.)  // Will be calculated
 {}
@@ -160,7 +160,7 @@ G4VPhysicalVolume* DetectorConstruction::DefineVolumes()
     G4int globalCellCopyNo = 0; // Unique ID for each cell across all planes
 
     // --- Create and Place the 4 Detector Planes and their Cells ---
-    for (int planeNum = 0; planeNum < 4; ++planeNum) {
+    for (int planeNum = 0; planeNum < kNofPlanes; ++planeNum) {
         // Create a NEW logical volume for EACH plane's envelope
         G4String planeEnvelopeS_Name = "PlaneEnvelopeS" + std::to_string(planeNum);
         G4Box* planeEnvelopeS = new G4Box(planeEnvelopeS_Name,
@@ -21,6 +21,12 @@ public:
     virtual G4VPhysicalVolume* Construct() override;
     virtual void ConstructSDandField() override;
 
+    // Readout segmentation (cell copy numbers run plane by plane: 0-63 for plane 0, etc.)
+    static constexpr G4int kNofPlanes = 4;
+    static constexpr G4int kNofCellsPerSide = 8;
+    static constexpr G4int kNofCellsPerPlane = kNofCellsPerSide * kNofCellsPerSide;
+    static constexpr G4int kNofCells = kNofPlanes * kNofCellsPerPlane;
+
 
     // Get methods for accessing detector components
     const G4VPhysicalVolume* GetUpperDetector1PV() const { return fUpperDetector1PV; }
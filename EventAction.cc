@@ -1,47 +1,290 @@
 ﻿#include "EventAction.hh"
 #include "RunAction.hh"
+#include "MemoryMonitor.hh"
+#include "OutputWriter.hh"
+#include "SubEventResult.hh"
+#include "LiveMonitor.hh"
+#include "InferenceStream.hh"
 
 #include "G4Event.hh"
+#include "G4PrimaryVertex.hh"
+#include "G4EventManager.hh"
+#include "G4GenericMessenger.hh"
 #include "G4RunManager.hh"
 #include "G4RootAnalysisManager.hh"
+#include "G4ParticleDefinition.hh"
 #include "G4SystemOfUnits.hh"
 
+#include <ctime>
+#include <utility>
+
+namespace
+{
+    // CPU time of the calling thread, in seconds
+    G4double ThreadCpuTime()
+    {
+        timespec now;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        return now.tv_sec + 1e-9 * now.tv_nsec;
+    }
+}
+
 EventAction::EventAction(RunAction* runAction)
  : G4UserEventAction(),
-   fRunAction(runAction)
-{}
+   fRunAction(runAction),
+   fEdep(0.),
+   fSteps(0),
+   fSubEventWorker(false),
+   fMuonXSum(0.),
+   fMuonYSum(0.),
+   fMuonSteps(0),
+   fTagPrimaries(false),
+   fPrimaryID(1),
+   fRecord(nullptr),
+   fFillRecord(true),
+   fTriggerMinPlanes(0),
+   fTriggerPlaneThreshold(0.),
+   fTriggerEvaluated(false),
+   fTriggerAccepted(true),
+   fTriggerCpuTime(0.),
+   fMessenger(nullptr)
+{
+    fCellEdep.fill(0.);
+    fCellPhotons.fill(0);
+    fCellLight.fill(0.);
+
+#if G4VERSION_NUMBER >= 1120
+    fSubEventWorker = G4RunManager::GetRunManager()->GetRunManagerType() == G4RunManager::subEventWorkerRM;
+#endif
+
+    DefineCommands();
+}
+
+EventAction::~EventAction()
+{
+    if (fRecord != &fLocalRecord) delete fRecord;
+    delete fMessenger;
+}
+
+void EventAction::BeginTrack(G4int trackID, G4int parentID)
+{
+    if (!fTagPrimaries) return;
+
+    // A parent is always tracked before its secondaries, so its entry exists
+    if (parentID == 0) {
+        fPrimaryID = trackID;
+    } else {
+        fPrimaryID = parentID < static_cast<G4int>(fPrimaryOfTrack.size()) ? fPrimaryOfTrack[parentID] : 0;
+    }
+    if (trackID >= static_cast<G4int>(fPrimaryOfTrack.size())) {
+        fPrimaryOfTrack.resize(trackID + 1, 0);
+    }
+    fPrimaryOfTrack[trackID] = fPrimaryID;
+}
+
+void EventAction::DefineCommands()
+{
+    fMessenger = new G4GenericMessenger(this, "/tomography/trigger/", "Software trigger");
 
-void EventAction::BeginOfEventAction(const G4Event*)
+    auto& minPlanesCmd = fMessenger->DeclareProperty("minPlanes", fTriggerMinPlanes,
+        "Keep events with hits in at least this many planes; others are aborted early (0 = off).");
+    minPlanesCmd.SetParameterName("k", false);
+    minPlanesCmd.SetRange("k>=0 && k<=4");
+    minPlanesCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& thresholdCmd = fMessenger->DeclarePropertyWithUnit("planeThreshold", "keV", fTriggerPlaneThreshold,
+        "Energy deposited in a plane for it to count as hit.");
+    thresholdCmd.SetParameterName("threshold", false);
+    thresholdCmd.SetRange("threshold>=0.");
+    thresholdCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+}
+
+void EventAction::BeginOfEventAction(const G4Event* event)
 {
     fEdep = 0.;
+    fSteps = 0;
+    fCellEdep.fill(0.);
+    fCellPhotons.fill(0);
+    fCellLight.fill(0.);
+    fMuonXSum = 0.;
+    fMuonYSum = 0.;
+    fMuonSteps = 0;
+
+    // A single primary needs no lookup: every row descends from track 1. The
+    // parents of sub-event tracks live in the master's event, so those stay unknown.
+    G4int nofPrimaries = 0;
+    if (!fSubEventWorker) {
+        for (G4int i = 0; i < event->GetNumberOfPrimaryVertex(); ++i) {
+            nofPrimaries += event->GetPrimaryVertex(i)->GetNumberOfParticle();
+        }
+    }
+    fTagPrimaries = nofPrimaries > 1;
+    fPrimaryID = fSubEventWorker ? 0 : 1;
+    fPrimaryOfTrack.clear();
+
+    fTriggerEvaluated = false;
+    fTriggerAccepted = true;
+
+    // Records come back recycled from the writer thread when it is used.
+    // A record kept from a rejected event is reused as is.
+    OutputQueue* outputQueue = fRunAction->GetOutputQueue();
+    if (outputQueue && !fSubEventWorker) {
+        if (!fRecord || fRecord == &fLocalRecord) fRecord = outputQueue->Acquire();
+    } else {
+        if (fRecord != &fLocalRecord) delete fRecord;
+        fRecord = &fLocalRecord;
+    }
+    fRecord->Clear(event->GetEventID());
+    fFillRecord = fRunAction->IsFileOutput() && !fRunAction->IsHistogramMode();
+}
+
+G4bool EventAction::EvaluateTrigger()
+{
+    if (fTriggerEvaluated) return fTriggerAccepted;
+
+    // Cell copy numbers run plane by plane
+    std::array<G4double, DetectorConstruction::kNofPlanes> planeEdep{};
+    for (G4int cellID = 0; cellID < DetectorConstruction::kNofCells; ++cellID) {
+        planeEdep[cellID / DetectorConstruction::kNofCellsPerPlane] += fCellEdep[cellID];
+    }
+
+    G4int planesHit = 0;
+    for (G4double edep : planeEdep) {
+        if (edep > fTriggerPlaneThreshold) ++planesHit;
+    }
+
+    fTriggerEvaluated = true;
+    fTriggerAccepted = planesHit >= fTriggerMinPlanes;
+    fTriggerCpuTime = ThreadCpuTime();
+    return fTriggerAccepted;
 }
 
 void EventAction::EndOfEventAction(const G4Event* event)
 {
+    LiveMonitor& liveMonitor = LiveMonitor::Instance();
+    liveMonitor.AddSteps(fSteps);
+
+    if (fSubEventWorker) {
+        FinishSubEvent();
+        return;
+    }
+
+    OutputQueue* outputQueue = fRunAction->GetOutputQueue();
+    liveMonitor.EventDone(event->GetEventID(), outputQueue ? outputQueue->GetDepth() : 0);
+
+    MemoryMonitor* memoryMonitor = fRunAction->GetMemoryMonitor();
+    memoryMonitor->Sample(event->GetEventID());
+
+    // Photons tracked in sub-events; merged before the parent event ends
+    if (auto* subEvents = dynamic_cast<const SubEventResult*>(event->GetUserInformation())) {
+        AddSubEventResult(*subEvents);
+    }
+
+    // Events without secondaries never reach a new stage: decide here
+    if (IsTriggerEnabled()) {
+        G4bool accepted = EvaluateTrigger();
+        fRunAction->AddTriggerDecision(accepted, accepted ? ThreadCpuTime() - fTriggerCpuTime : 0.);
+        if (!accepted) return;
+    }
+
     fRunAction->AddEdep(fEdep);
-    
-    // CRITICAL: Manually write ROOT data every 50 events to prevent memory overflow
-    // This is essential to prevent corruption around event 775
-    G4int eventID = event->GetEventID();
-    
-    // Write more frequently than every 100 events to be safe
-    if (eventID > 0 && eventID % 50 == 0) {
-        G4RootAnalysisManager* analysisManager = G4RootAnalysisManager::Instance();
-        
-        // Force write to disk
-        analysisManager->Write();
-        
-        G4cout << "EventAction: Forced write to ROOT file at event " << eventID 
-               << " to prevent memory overflow." << G4endl;
-    }
-    
-    // Additional safety check - if we're approaching the problematic event range
-    if (eventID > 700 && eventID < 850) {
-        // Write even more frequently in the danger zone
-        if (eventID % 10 == 0) {
-            G4RootAnalysisManager* analysisManager = G4RootAnalysisManager::Instance();
-            analysisManager->Write();
-            G4cout << "EventAction: Extra safety write at event " << eventID << G4endl;
-        }
+
+    InferenceStream& stream = InferenceStream::Instance();
+    if (stream.IsPublishing()) {
+        G4double xTrue = fMuonSteps > 0 ? fMuonXSum / fMuonSteps / cm : 0.;
+        G4double yTrue = fMuonSteps > 0 ? fMuonYSum / fMuonSteps / cm : 0.;
+        stream.Publish(event->GetEventID(), fCellLight, xTrue, yTrue, fMuonSteps);
+    }
+
+    if (!fRunAction->IsFileOutput()) return;
+
+    // Calibration runs only fill histograms; they are written once at end of run
+    if (fRunAction->IsHistogramMode()) {
+        FillCalibrationHistograms();
+        return;
+    }
+
+    // The writer thread's buffers are not visible from here
+    if (memoryMonitor->IsEnabled() && !outputQueue) {
+        memoryMonitor->AddNtupleBytes(fRunAction->GetSpectrumNtupleId(), fRecord->GetSpectrumBytes());
+        memoryMonitor->AddNtupleBytes(fRunAction->GetEdepNtupleId(), fRecord->GetEdepBytes());
+        memoryMonitor->AddNtupleBytes(fRunAction->GetMuonTrackNtupleId(), fRecord->GetMuonStepBytes());
+    }
+
+    // Hand the rows to the writer thread, or fill and write them here
+    if (outputQueue) {
+        outputQueue->Push(fRecord);
+        fRecord = nullptr;
+    } else {
+        fRunAction->WriteEventRecord(*fRecord);
+        fRunAction->FlushIfDue(fRecord->eventID);
     }
-}
\ No newline at end of file
+}
+
+void EventAction::FinishSubEvent()
+{
+    auto* result = new SubEventResult;
+    result->edep = fEdep;
+    result->cellEdep = fCellEdep;
+    result->cellPhotons = fCellPhotons;
+    result->cellLight = fCellLight;
+    std::swap(result->rows, *fRecord);
+
+    // Owned by the sub-event from here on
+    G4EventManager::GetEventManager()->SetUserInformation(result);
+}
+
+#if G4VERSION_NUMBER >= 1120
+void EventAction::MergeSubEvent(G4Event* masterEvent, const G4Event* subEvent)
+{
+    auto* result = dynamic_cast<const SubEventResult*>(subEvent->GetUserInformation());
+    if (!result) return;
+
+    // Called once per sub-event, serialized by the run manager
+    auto* merged = dynamic_cast<SubEventResult*>(masterEvent->GetUserInformation());
+    if (!merged) {
+        merged = new SubEventResult;
+        masterEvent->SetUserInformation(merged);
+    }
+    merged->Merge(*result);
+}
+#endif
+
+void EventAction::AddSubEventResult(const SubEventResult& result)
+{
+    fEdep += result.edep;
+    for (G4int cellID = 0; cellID < DetectorConstruction::kNofCells; ++cellID) {
+        fCellEdep[cellID] += result.cellEdep[cellID];
+        fCellPhotons[cellID] += result.cellPhotons[cellID];
+        fCellLight[cellID] += result.cellLight[cellID];
+    }
+    fRecord->Append(result.rows);
+}
+
+void EventAction::FillCalibrationHistograms() const
+{
+    G4RootAnalysisManager* analysisManager = G4RootAnalysisManager::Instance();
+
+    std::array<G4int, DetectorConstruction::kNofPlanes> planeHits{};
+
+    for (G4int cellID = 0; cellID < DetectorConstruction::kNofCells; ++cellID) {
+        G4double edep = fCellEdep[cellID];
+        G4int photons = fCellPhotons[cellID];
+        if (edep <= 0. && photons == 0) continue;
+
+        G4int plane = cellID / DetectorConstruction::kNofCellsPerPlane;
+        G4int cellInPlane = cellID % DetectorConstruction::kNofCellsPerPlane;
+
+        analysisManager->FillH1(fRunAction->GetCellLightH1Id(cellID), photons);
+        analysisManager->FillH1(fRunAction->GetCellEdepH1Id(cellID), edep);
+        analysisManager->FillH2(fRunAction->GetPlaneLightMapH2Id(plane),
+                                cellInPlane % DetectorConstruction::kNofCellsPerSide + 0.5,
+                                cellInPlane / DetectorConstruction::kNofCellsPerSide + 0.5,
+                                photons);
+        if (edep > 0.) ++planeHits[plane];
+    }
+
+    for (G4int plane = 0; plane < DetectorConstruction::kNofPlanes; ++plane) {
+        analysisManager->FillH1(fRunAction->GetPlaneMultiplicityH1Id(plane), planeHits[plane]);
+    }
+}
@@ -2,26 +2,104 @@
 #define EventAction_h 1
 
 #include "G4UserEventAction.hh"
+#include "G4Version.hh"
+#include "DetectorConstruction.hh"
+#include "EventRecord.hh"
 #include "globals.hh"
 
+#include <array>
+#include <vector>
+
 class RunAction;
+class SubEventResult;
+class G4GenericMessenger;
 
 class EventAction : public G4UserEventAction
 {
 public:
     EventAction(RunAction* runAction);
-    virtual ~EventAction() = default;
+    virtual ~EventAction();
 
     virtual void BeginOfEventAction(const G4Event* event) override;
     virtual void EndOfEventAction(const G4Event* event) override;
 
+#if G4VERSION_NUMBER >= 1120
+    // Sub-event parallel mode: accumulate a finished photon sub-event on its parent
+    virtual void MergeSubEvent(G4Event* masterEvent, const G4Event* subEvent) override;
+#endif
+
     void AddEdep(G4double edep) { fEdep += edep; }
+    void CountStep() { ++fSteps; }
+
+    // Per-cell sums for the current event, indexed by cell copy number
+    void AddCellEdep(G4int cellID, G4double edep) { fCellEdep[cellID] += edep; }
+    void AddCellPhoton(G4int cellID, G4double energy)
+    {
+        ++fCellPhotons[cellID];
+        fCellLight[cellID] += energy;
+    }
+
+    // Truth muon position, averaged over the primary muon's pre-step points
+    void AddMuonStep(const G4ThreeVector& prePosition)
+    {
+        fMuonXSum += prePosition.x();
+        fMuonYSum += prePosition.y();
+        ++fMuonSteps;
+    }
+
+    // Pile-up tagging: called by TrackingAction before each track is stepped.
+    // GetPrimaryID() is the track ID of the primary the current track descends from.
+    void BeginTrack(G4int trackID, G4int parentID);
+    G4int GetPrimaryID() const { return fPrimaryID; }
+
+    // Software trigger: hits in at least fTriggerMinPlanes of the planes, from the
+    // energy deposited so far. Evaluated once per event; a rejected event writes nothing.
+    G4bool IsTriggerEnabled() const { return fTriggerMinPlanes > 0; }
+    G4bool EvaluateTrigger();
+
+    // Ntuple rows of the current event; nullptr when nothing is written to file
+    EventRecord* GetRecord() { return fFillRecord ? fRecord : nullptr; }
 
     const RunAction* GetRunAction() const { return fRunAction; }
 
 private:
+    void DefineCommands();
+    void FillCalibrationHistograms() const;
+    void AddSubEventResult(const SubEventResult& result);
+
+    // Hand this sub-event's sums and rows to the parent event instead of writing them
+    void FinishSubEvent();
+
     RunAction* fRunAction;
     G4double   fEdep;
+    G4long     fSteps;
+
+    G4bool fSubEventWorker; // this thread tracks sub-events of events owned by the master
+
+    std::array<G4double, DetectorConstruction::kNofCells> fCellEdep;
+    std::array<G4int, DetectorConstruction::kNofCells>    fCellPhotons;
+    std::array<G4double, DetectorConstruction::kNofCells> fCellLight; // optical photon energy
+
+    G4double fMuonXSum;
+    G4double fMuonYSum;
+    G4int    fMuonSteps;
+
+    // Originating primary per track ID, only kept for events with several primaries
+    G4bool fTagPrimaries;
+    G4int  fPrimaryID;
+    std::vector<G4int> fPrimaryOfTrack;
+
+    EventRecord* fRecord;      // from the output queue, or points to fLocalRecord
+    EventRecord  fLocalRecord;
+    G4bool       fFillRecord;
+
+    G4int    fTriggerMinPlanes;
+    G4double fTriggerPlaneThreshold;
+    G4bool   fTriggerEvaluated;
+    G4bool   fTriggerAccepted;
+    G4double fTriggerCpuTime; // thread CPU time when the trigger was evaluated
+
+    G4GenericMessenger* fMessenger;
 };
 
 #endif
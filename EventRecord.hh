@@ -0,0 +1,74 @@
+﻿#ifndef EventRecord_h
+#define EventRecord_h 1
+
+#include "G4ThreeVector.hh"
+#include "G4ParticleDefinition.hh"
+#include "globals.hh"
+
+#include <vector>
+
+class G4ParticleDefinition;
+
+// Ntuple rows of one event. SteppingAction buffers them here while the event is
+// simulated; at end of event they are filled into the ntuples, either directly or
+// by the OutputWriter thread. Energies and positions are in Geant4 internal units.
+// primaryID is the track ID of the primary a row descends from (1 for single-muon
+// events, 0 when not known, i.e. for photons tracked in sub-events).
+struct EventRecord
+{
+    struct EdepRow
+    {
+        G4int cellID;
+        G4double edep;
+        G4int primaryID;
+    };
+
+    struct SpectrumRow
+    {
+        G4int cellID;
+        const G4ParticleDefinition* particle;
+        G4double energy;
+        G4int primaryID;
+    };
+
+    struct MuonStepRow
+    {
+        G4ThreeVector prePosition;
+        G4ThreeVector postPosition;
+        G4int primaryID;
+    };
+
+    // Keeps the vector capacity, so recycled records do not reallocate
+    void Clear(G4int id)
+    {
+        eventID = id;
+        edep.clear();
+        spectrum.clear();
+        muonSteps.clear();
+    }
+
+    // Adds the rows of another part of the same event (e.g. a sub-event)
+    void Append(const EventRecord& other)
+    {
+        edep.insert(edep.end(), other.edep.begin(), other.edep.end());
+        spectrum.insert(spectrum.end(), other.spectrum.begin(), other.spectrum.end());
+        muonSteps.insert(muonSteps.end(), other.muonSteps.begin(), other.muonSteps.end());
+    }
+
+    // Uncompressed column payload each table adds to its ntuple
+    std::size_t GetEdepBytes() const { return edep.size() * (3*sizeof(G4int) + sizeof(G4double)); }
+    std::size_t GetMuonStepBytes() const { return muonSteps.size() * (2*sizeof(G4int) + 6*sizeof(G4double)); }
+    std::size_t GetSpectrumBytes() const
+    {
+        std::size_t bytes = spectrum.size() * (3*sizeof(G4int) + sizeof(G4double) + 1);
+        for (const auto& row : spectrum) bytes += row.particle->GetParticleName().size();
+        return bytes;
+    }
+
+    G4int eventID = -1;
+    std::vector<EdepRow> edep;
+    std::vector<SpectrumRow> spectrum;
+    std::vector<MuonStepRow> muonSteps;
+};
+
+#endif
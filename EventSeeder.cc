@@ -0,0 +1,70 @@
+﻿#include "EventSeeder.hh"
+
+#include "Randomize.hh"
+
+#include <atomic>
+#include <cstdint>
+
+namespace
+{
+    std::atomic<G4long> gRunSeed{0};
+    std::atomic<G4int>  gRunID{0};
+    std::atomic<G4bool> gEnabled{true};
+
+    // SplitMix64 finalizer: well-mixed 64-bit output from consecutive inputs
+    std::uint64_t Mix(std::uint64_t x)
+    {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+}
+
+void EventSeeder::SetRunSeed(G4long runSeed)
+{
+    gRunSeed.store(runSeed);
+}
+
+G4long EventSeeder::GetRunSeed()
+{
+    return gRunSeed.load();
+}
+
+void EventSeeder::SetRunID(G4int runID)
+{
+    gRunID.store(runID);
+}
+
+void EventSeeder::SetEnabled(G4bool enabled)
+{
+    gEnabled.store(enabled);
+}
+
+G4bool EventSeeder::IsEnabled()
+{
+    return gEnabled.load();
+}
+
+G4long EventSeeder::RunSeedFromEngine()
+{
+    // Only the first two seeds are used: that is the full state of RanecuEngine
+    const long* seeds = G4Random::getTheSeeds();
+    std::uint64_t hash = Mix(static_cast<std::uint64_t>(seeds[0]));
+    hash = Mix(hash ^ static_cast<std::uint64_t>(seeds[1]));
+    return static_cast<G4long>(hash & 0x7FFFFFFFFFFFFFFFULL);
+}
+
+void EventSeeder::SeedEvent(G4int eventID)
+{
+    std::uint64_t state = Mix(static_cast<std::uint64_t>(gRunSeed.load()));
+    state = Mix(state ^ static_cast<std::uint64_t>(static_cast<std::uint32_t>(gRunID.load())));
+    state = Mix(state ^ static_cast<std::uint64_t>(static_cast<std::uint32_t>(eventID)));
+
+    // RanecuEngine takes two positive 31-bit seeds; the list is zero-terminated
+    long seeds[3];
+    seeds[0] = static_cast<long>((state >> 33) | 1);
+    seeds[1] = static_cast<long>(((state >> 2) & 0x7FFFFFFFULL) | 1);
+    seeds[2] = 0;
+    G4Random::setTheSeeds(seeds);
+}
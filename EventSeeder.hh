@@ -0,0 +1,31 @@
+﻿#ifndef EventSeeder_h
+#define EventSeeder_h 1
+
+#include "globals.hh"
+
+// Derives the random engine state of every event from (run seed, run ID, EventID)
+// only, so that event content does not depend on the number of threads, on which
+// thread processes an event or on how a job is sharded, while successive runs of
+// one job (EventIDs restart at 0) still get different events.
+// The run seed and run ID are published once per run by the master RunAction and
+// read by the PrimaryGeneratorAction of every thread before it generates an event.
+class EventSeeder
+{
+public:
+    static void SetRunSeed(G4long runSeed);
+    static G4long GetRunSeed();
+
+    static void SetRunID(G4int runID);
+
+    static void SetEnabled(G4bool enabled);
+    static G4bool IsEnabled();
+
+    // Run seed built from the current state of the master engine
+    // (i.e. from /random/setSeeds when no explicit run seed is given)
+    static G4long RunSeedFromEngine();
+
+    // Reseed the engine of the calling thread for the given event
+    static void SeedEvent(G4int eventID);
+};
+
+#endif
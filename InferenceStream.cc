@@ -0,0 +1,218 @@
+﻿#include "InferenceStream.hh"
+
+#include "G4GenericMessenger.hh"
+
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct InferenceStream::Header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+    std::uint64_t capacity;
+    std::uint32_t nCells;
+    std::uint32_t blocking;
+    std::int64_t producerPid;
+    std::atomic<std::int64_t> producerState;
+    std::atomic<std::uint64_t> writeCursor;
+    std::atomic<std::uint64_t> readCursor;
+    std::atomic<std::int64_t> consumerPid;
+    std::atomic<std::uint64_t> overwritten;
+    char padding[48];
+};
+
+struct InferenceStream::RecordHead
+{
+    std::atomic<std::uint64_t> sequence;
+    std::int64_t eventID;
+    double xTrue;
+    double yTrue;
+    std::int32_t nMuonSteps;
+    std::int32_t reserved;
+    // followed by float light[nCells]
+};
+
+InferenceStream& InferenceStream::Instance()
+{
+    static InferenceStream instance;
+    return instance;
+}
+
+InferenceStream::InferenceStream()
+ : fEnabled(false),
+   fBlocking(false),
+   fCapacity(4096),
+   fName("/tomography_stream"),
+   fMessenger(nullptr),
+   fHeader(nullptr),
+   fRecordSize(0),
+   fSize(0)
+{
+    static_assert(sizeof(Header) == 128, "InferenceStream header must be 128 bytes");
+    static_assert(sizeof(RecordHead) == 40, "InferenceStream record head must be 40 bytes");
+
+    // Process-wide: the commands live on the master and are not broadcast
+    fMessenger = new G4GenericMessenger(this, "/tomography/stream/", "Shared-memory event stream for online inference");
+
+    auto& enableCmd = fMessenger->DeclareProperty("enable", fEnabled,
+        "Publish every accepted event's cell light map and truth muon position in shared memory.");
+    enableCmd.SetParameterName("flag", true);
+    enableCmd.SetDefaultValue("true");
+    enableCmd.SetToBeBroadcasted(false);
+    enableCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& nameCmd = fMessenger->DeclareProperty("name", fName,
+        "Shared-memory segment name.");
+    nameCmd.SetParameterName("name", false);
+    nameCmd.SetToBeBroadcasted(false);
+    nameCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& capacityCmd = fMessenger->DeclareProperty("capacity", fCapacity,
+        "Records held by the ring (rounded up to a power of two).");
+    capacityCmd.SetParameterName("records", false);
+    capacityCmd.SetRange("records>0");
+    capacityCmd.SetToBeBroadcasted(false);
+    capacityCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& blockingCmd = fMessenger->DeclareProperty("blocking", fBlocking,
+        "Wait for an attached consumer when the ring is full instead of overwriting unread records.");
+    blockingCmd.SetParameterName("flag", true);
+    blockingCmd.SetDefaultValue("true");
+    blockingCmd.SetToBeBroadcasted(false);
+    blockingCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+}
+
+InferenceStream::~InferenceStream()
+{
+    // A consumer that has the segment mapped keeps reading what is left
+    Header* header = fHeader.load();
+    if (header) {
+        header->producerState.store(2, std::memory_order_release);
+        munmap(header, fSize);
+        shm_unlink(fName.c_str());
+    }
+    delete fMessenger;
+}
+
+void InferenceStream::Open()
+{
+    std::uint64_t capacity = 1;
+    while (capacity < static_cast<std::uint64_t>(fCapacity)) capacity <<= 1;
+
+    std::size_t payload = sizeof(RecordHead) + DetectorConstruction::kNofCells * sizeof(float);
+    fRecordSize = (payload + 63) / 64 * 64;
+    fSize = sizeof(Header) + capacity * fRecordSize;
+
+    // A new segment, so a consumer never mixes records of two jobs
+    shm_unlink(fName.c_str());
+    int fd = shm_open(fName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, fSize) != 0) {
+        if (fd >= 0) close(fd);
+        G4Exception("InferenceStream::Open()", "SharedMemoryError", JustWarning,
+                    ("Cannot create " + fName + ": " + std::strerror(errno) + "; streaming disabled.").c_str());
+        fEnabled = false;
+        return;
+    }
+    void* mapping = mmap(nullptr, fSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(fName.c_str());
+        G4Exception("InferenceStream::Open()", "SharedMemoryError", JustWarning,
+                    ("Cannot map " + fName + "; streaming disabled.").c_str());
+        fEnabled = false;
+        return;
+    }
+
+    // Zero-filled: cursors at 0, every slot sequence 0 (empty)
+    auto* header = static_cast<Header*>(mapping);
+    header->version = 1;
+    header->recordSize = fRecordSize;
+    header->capacity = capacity;
+    header->nCells = DetectorConstruction::kNofCells;
+    header->blocking = fBlocking ? 1 : 0;
+    header->producerPid = getpid();
+    header->producerState.store(1, std::memory_order_relaxed);
+    std::memcpy(header->magic, "CMTSTRM1", sizeof(header->magic));
+
+    fHeader.store(header, std::memory_order_release);
+    G4cout << "InferenceStream: publishing events in shared memory " << fName << " ("
+           << capacity << " records of " << fRecordSize << " bytes"
+           << (fBlocking ? ", blocking" : "") << ")" << G4endl;
+}
+
+void InferenceStream::BeginOfRun()
+{
+    if (fEnabled && !fHeader.load()) Open();
+
+    Header* header = fHeader.load();
+    if (!header) return;
+    header->blocking = fBlocking ? 1 : 0;
+    header->producerState.store(1, std::memory_order_release);
+}
+
+void InferenceStream::EndOfRun()
+{
+    // Every record of the run is complete: the workers have finished their events
+    Header* header = fHeader.load();
+    if (header) header->producerState.store(2, std::memory_order_release);
+}
+
+G4bool InferenceStream::ConsumerAlive() const
+{
+    std::int64_t pid = fHeader.load(std::memory_order_relaxed)->consumerPid.load(std::memory_order_acquire);
+    return pid > 0 && kill(static_cast<pid_t>(pid), 0) == 0;
+}
+
+void InferenceStream::Publish(G4int eventID, const std::array<G4double, DetectorConstruction::kNofCells>& cellLight,
+                              G4double xTrue, G4double yTrue, G4int nMuonSteps)
+{
+    Header* header = fHeader.load(std::memory_order_acquire);
+    if (!header) return;
+
+    std::uint64_t n = header->writeCursor.fetch_add(1, std::memory_order_relaxed);
+    std::uint64_t capacity = header->capacity;
+
+    // Back-pressure: wait until the consumer has finished with the record in this slot.
+    // A consumer that exits (or never attached) stops the waiting.
+    if (header->blocking) {
+        G4int spins = 0;
+        while (n >= header->readCursor.load(std::memory_order_acquire) + capacity) {
+            if (++spins % 1024 == 0 && !ConsumerAlive()) break;
+            std::this_thread::yield();
+        }
+    }
+
+    char* slot = reinterpret_cast<char*>(header + 1) + (n & (capacity - 1)) * fRecordSize;
+    auto* head = reinterpret_cast<RecordHead*>(slot);
+
+    // The producer of record n - capacity may still be writing this slot
+    if (n >= capacity) {
+        while (head->sequence.load(std::memory_order_acquire) < 2*(n - capacity) + 2) {
+            std::this_thread::yield();
+        }
+        if (n >= header->readCursor.load(std::memory_order_relaxed) + capacity) {
+            header->overwritten.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    head->sequence.store(2*n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    head->eventID = eventID;
+    head->xTrue = xTrue;
+    head->yTrue = yTrue;
+    head->nMuonSteps = nMuonSteps;
+    auto* light = reinterpret_cast<float*>(slot + sizeof(RecordHead));
+    for (G4int cellID = 0; cellID < DetectorConstruction::kNofCells; ++cellID) {
+        light[cellID] = static_cast<float>(cellLight[cellID]);
+    }
+
+    head->sequence.store(2*n + 2, std::memory_order_release);
+}
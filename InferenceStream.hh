@@ -0,0 +1,86 @@
+﻿#ifndef InferenceStream_h
+#define InferenceStream_h 1
+
+#include "DetectorConstruction.hh"
+#include "globals.hh"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class G4GenericMessenger;
+
+// Ring buffer in POSIX shared memory through which every accepted event is
+// published as a fixed-size record (light per cell, truth muon position) for an
+// online consumer in another process, e.g. the position-reconstruction model
+// (see inference_consumer.py). Simulation threads write their record straight
+// into the ring, without copies or file I/O. Enabled with /tomography/stream/enable.
+//
+// Layout (little endian, x86-64):
+//   Header, 128 bytes:
+//     char    magic[8]          "CMTSTRM1"
+//     uint32  version           1
+//     uint32  recordSize        bytes per slot (multiple of 64)
+//     uint64  capacity          number of slots, a power of two
+//     uint32  nCells            light values per record
+//     uint32  blocking          1: producers wait for an attached consumer instead of
+//                               overwriting records it has not read
+//     int64   producerPid       consumers check that it is alive: a killed or aborted
+//                               producer never sets the state to finished
+//     int64   producerState     1 running, 2 finished (end of run: no more records unless
+//                               a new run sets it back to 1)
+//     uint64  writeCursor       number of records claimed by producers
+//     uint64  readCursor        written by the consumer: records it has finished with
+//     int64   consumerPid       written by the consumer when it attaches (0 = none)
+//     uint64  overwritten       records published over a slot the consumer had not read
+//     (zero padding up to 128 bytes)
+//   capacity slots of recordSize bytes; record number n lives in slot n % capacity:
+//     uint64  sequence          2n+1 while record n is written, 2n+2 once it is complete
+//     int64   eventID
+//     float64 xTrue, yTrue      mean muon pre-step position [cm]
+//     int32   nMuonSteps        0 when the muon missed the detector
+//     int32   reserved
+//     float32 light[nCells]     optical photon energy reaching each cell boundary [MeV],
+//                               indexed by cell copy number (plane * 64 + cell)
+//
+// A reader of record n waits until sequence == 2n+2, copies the record and checks
+// the sequence again: if it changed, the record was overwritten while being read.
+class InferenceStream
+{
+public:
+    static InferenceStream& Instance();
+
+    // Master: creates the segment on the first run after it was enabled, and
+    // marks the producer running / finished
+    void BeginOfRun();
+    void EndOfRun();
+
+    G4bool IsPublishing() const { return fHeader.load(std::memory_order_relaxed) != nullptr; }
+
+    // Any simulation thread, once per accepted event
+    void Publish(G4int eventID, const std::array<G4double, DetectorConstruction::kNofCells>& cellLight,
+                 G4double xTrue, G4double yTrue, G4int nMuonSteps);
+
+private:
+    struct Header;
+    struct RecordHead;
+
+    InferenceStream();
+    ~InferenceStream();
+
+    void Open();
+    G4bool ConsumerAlive() const;
+
+    G4bool fEnabled;
+    G4bool fBlocking;
+    G4int fCapacity;
+    G4String fName;
+    G4GenericMessenger* fMessenger;
+
+    std::atomic<Header*> fHeader;
+    std::size_t fRecordSize;
+    std::size_t fSize;
+};
+
+#endif
@@ -0,0 +1,207 @@
+﻿#include "LiveMonitor.hh"
+#include "MemoryMonitor.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4Threading.hh"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+    const G4int kNofSlots = 256;
+
+    std::uint64_t NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+}
+
+struct LiveMonitor::Header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t nSlots;
+    std::int64_t pid;
+    std::atomic<std::int64_t> runID;
+    std::atomic<std::int64_t> runActive;
+    std::atomic<std::int64_t> eventsToProcess;
+    std::atomic<std::uint64_t> eventsAtRunStart;
+    std::atomic<std::uint64_t> rssBytes;
+    std::atomic<std::uint64_t> rssTimeNs;
+    char padding[56];
+};
+
+struct LiveMonitor::Slot
+{
+    std::atomic<std::int64_t> active;
+    std::atomic<std::uint64_t> events;
+    std::atomic<std::uint64_t> steps;
+    std::atomic<std::uint64_t> outputBytes;
+    std::atomic<std::uint64_t> queueDepth;
+    std::atomic<std::int64_t> lastEventID;
+    std::atomic<std::uint64_t> heartbeatNs;
+    std::uint64_t reserved;
+};
+
+LiveMonitor& LiveMonitor::Instance()
+{
+    static LiveMonitor instance;
+    return instance;
+}
+
+LiveMonitor::LiveMonitor()
+ : fEnabled(false),
+   fMessenger(nullptr),
+   fHeader(nullptr),
+   fSize(sizeof(Header) + kNofSlots * sizeof(Slot))
+{
+    static_assert(sizeof(std::atomic<std::uint64_t>) == 8 && std::atomic<std::uint64_t>::is_always_lock_free,
+                  "LiveMonitor counters must be plain lock-free 64-bit words");
+    static_assert(sizeof(Header) == 128, "LiveMonitor header must be 128 bytes");
+    static_assert(sizeof(Slot) == 64, "LiveMonitor slot must be 64 bytes");
+
+    // Process-wide: the commands live on the master and are not broadcast
+    fMessenger = new G4GenericMessenger(this, "/tomography/monitor/", "Live run monitoring");
+
+    auto& enableCmd = fMessenger->DeclareProperty("enable", fEnabled,
+        "Publish run-progress counters in shared memory for monitor_reader.py.");
+    enableCmd.SetParameterName("flag", true);
+    enableCmd.SetDefaultValue("true");
+    enableCmd.SetToBeBroadcasted(false);
+    enableCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& nameCmd = fMessenger->DeclareProperty("name", fName,
+        "Shared-memory segment name (default /tomography_monitor_<pid>).");
+    nameCmd.SetParameterName("name", false);
+    nameCmd.SetToBeBroadcasted(false);
+    nameCmd.AvailableForStates(G4State_PreInit);
+}
+
+LiveMonitor::~LiveMonitor()
+{
+    Header* header = fHeader.load();
+    if (header) {
+        munmap(header, fSize);
+        shm_unlink(fName.c_str());
+    }
+    delete fMessenger;
+}
+
+void LiveMonitor::Open()
+{
+    if (fName.empty()) fName = "/tomography_monitor_" + std::to_string(getpid());
+
+    int fd = shm_open(fName.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, fSize) != 0) {
+        if (fd >= 0) close(fd);
+        G4Exception("LiveMonitor::Open()", "SharedMemoryError", JustWarning,
+                    ("Cannot create " + fName + ": " + std::strerror(errno) + "; live monitoring disabled.").c_str());
+        fEnabled = false;
+        return;
+    }
+    void* mapping = mmap(nullptr, fSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(fName.c_str());
+        G4Exception("LiveMonitor::Open()", "SharedMemoryError", JustWarning,
+                    ("Cannot map " + fName + "; live monitoring disabled.").c_str());
+        fEnabled = false;
+        return;
+    }
+
+    // A fresh segment is zero-filled, which is the initial value of every counter
+    auto* header = static_cast<Header*>(mapping);
+    header->version = 1;
+    header->nSlots = kNofSlots;
+    header->pid = getpid();
+    std::memcpy(header->magic, "CMTMON01", sizeof(header->magic));
+
+    fHeader.store(header, std::memory_order_release);
+    G4cout << "LiveMonitor: publishing run progress in shared memory " << fName
+           << " (python monitor_reader.py " << fName << ")" << G4endl;
+}
+
+void LiveMonitor::BeginOfRun(G4int runID, G4int eventsToProcess)
+{
+    if (fEnabled && !fHeader.load()) Open();
+
+    Header* header = fHeader.load();
+    if (!header) return;
+
+    auto* slots = reinterpret_cast<Slot*>(header + 1);
+    std::uint64_t eventsDone = 0;
+    for (G4int i = 0; i < kNofSlots; ++i) eventsDone += slots[i].events.load(std::memory_order_relaxed);
+
+    header->eventsAtRunStart.store(eventsDone, std::memory_order_relaxed);
+    header->eventsToProcess.store(eventsToProcess, std::memory_order_relaxed);
+    header->runID.store(runID, std::memory_order_relaxed);
+    header->runActive.store(1, std::memory_order_relaxed);
+    UpdateProcessCounters(NowNs());
+}
+
+void LiveMonitor::EndOfRun()
+{
+    Header* header = fHeader.load();
+    if (!header) return;
+    header->runActive.store(0, std::memory_order_relaxed);
+    UpdateProcessCounters(NowNs());
+}
+
+LiveMonitor::Slot* LiveMonitor::GetSlot(G4int threadId) const
+{
+    Header* header = fHeader.load(std::memory_order_acquire);
+    if (!header) return nullptr;
+
+    G4int index = threadId + 1;
+    if (index < 0 || index >= kNofSlots) return nullptr;
+    return reinterpret_cast<Slot*>(header + 1) + index;
+}
+
+void LiveMonitor::UpdateProcessCounters(std::uint64_t now) const
+{
+    Header* header = fHeader.load(std::memory_order_acquire);
+
+    // Any thread may refresh the RSS; a duplicate refresh is harmless
+    std::uint64_t last = header->rssTimeNs.load(std::memory_order_relaxed);
+    if (now < last + 1000000000ull) return;
+    header->rssTimeNs.store(now, std::memory_order_relaxed);
+    header->rssBytes.store(static_cast<std::uint64_t>(MemoryMonitor::ReadResidentMB() * 1024. * 1024.),
+                           std::memory_order_relaxed);
+}
+
+void LiveMonitor::AddSteps(std::uint64_t steps)
+{
+    Slot* slot = GetSlot();
+    if (!slot) return;
+
+    std::uint64_t now = NowNs();
+    slot->steps.fetch_add(steps, std::memory_order_relaxed);
+    slot->heartbeatNs.store(now, std::memory_order_relaxed);
+    slot->active.store(1, std::memory_order_relaxed);
+    UpdateProcessCounters(now);
+}
+
+void LiveMonitor::EventDone(G4int eventID, std::size_t queueDepth)
+{
+    Slot* slot = GetSlot();
+    if (!slot) return;
+
+    slot->events.fetch_add(1, std::memory_order_relaxed);
+    slot->lastEventID.store(eventID, std::memory_order_relaxed);
+    slot->queueDepth.store(queueDepth, std::memory_order_relaxed);
+}
+
+void LiveMonitor::AddOutputBytes(std::size_t bytes, G4int threadId)
+{
+    // With the async writer this runs on the writer thread, on behalf of the
+    // thread that simulated the event
+    Slot* slot = GetSlot(threadId);
+    if (slot) slot->outputBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
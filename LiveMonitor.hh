@@ -0,0 +1,76 @@
+﻿#ifndef LiveMonitor_h
+#define LiveMonitor_h 1
+
+#include "globals.hh"
+#include "G4Threading.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class G4GenericMessenger;
+
+// Run-progress counters published in a POSIX shared-memory segment while the job
+// runs, for monitor_reader.py (or any other reader) to poll. Updating costs a few
+// relaxed atomic stores per event; nothing is published unless enabled with
+// /tomography/monitor/enable true. The segment is removed when the process exits.
+//
+// Layout (native endianness, all fields 8-byte aligned):
+//   Header, 128 bytes:
+//     char    magic[8]            "CMTMON01"
+//     uint32  version             1
+//     uint32  nSlots              number of thread slots that follow
+//     int64   pid
+//     int64   runID               current (or last) run
+//     int64   runActive           1 between begin and end of run
+//     int64   eventsToProcess     of the current run
+//     uint64  eventsAtRunStart    sum of the slot event counters when the run began
+//     uint64  rssBytes            process resident set, refreshed about once per second
+//     uint64  rssTimeNs           wall-clock time (ns since the epoch) of that refresh
+//     (zero padding up to 128 bytes)
+//   nSlots thread slots, 64 bytes each (slot 0: master or sequential, slot i: worker i-1):
+//     int64   active              1 once the thread has published
+//     uint64  events              events finished by the thread, cumulative over runs
+//     uint64  steps               tracking steps, cumulative
+//     uint64  outputBytes         uncompressed ntuple payload filled for the thread's events
+//     uint64  queueDepth          events waiting in the thread's writer queue
+//     int64   lastEventID
+//     uint64  heartbeatNs         wall-clock time of the thread's last update
+//     uint64  reserved
+class LiveMonitor
+{
+public:
+    static LiveMonitor& Instance();
+
+    // Master: creates the segment on the first run after it was enabled
+    void BeginOfRun(G4int runID, G4int eventsToProcess);
+    void EndOfRun();
+
+    // Any thread; no-ops unless the segment is open
+    void AddSteps(std::uint64_t steps);
+    void EventDone(G4int eventID, std::size_t queueDepth);
+    void AddOutputBytes(std::size_t bytes, G4int threadId); // on behalf of the given thread
+
+    G4bool IsPublishing() const { return fHeader.load(std::memory_order_relaxed) != nullptr; }
+
+private:
+    struct Header;
+    struct Slot;
+
+    LiveMonitor();
+    ~LiveMonitor();
+
+    void Open();
+    Slot* GetSlot() const { return GetSlot(G4Threading::G4GetThreadId()); }
+    Slot* GetSlot(G4int threadId) const;
+    void UpdateProcessCounters(std::uint64_t now) const;
+
+    G4bool fEnabled;
+    G4String fName;
+    G4GenericMessenger* fMessenger;
+
+    std::atomic<Header*> fHeader;
+    std::size_t fSize;
+};
+
+#endif
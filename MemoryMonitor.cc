@@ -0,0 +1,147 @@
+﻿#include "MemoryMonitor.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4Threading.hh"
+#include "G4AllocatorList.hh"
+#include "G4Track.hh"
+#include "G4DynamicParticle.hh"
+
+#include <algorithm>
+#include <unistd.h>
+
+MemoryMonitor::MemoryMonitor()
+ : fSampleInterval(0),
+   fFileName("memory_profile"),
+   fMessenger(nullptr),
+   fFlushPending(false),
+   fEventsSeen(0),
+   fPeakResidentMB(0.),
+   fPeakResidentEvent(-1)
+{
+    fMessenger = new G4GenericMessenger(this, "/tomography/memory/", "Memory usage sampling");
+
+    auto& intervalCmd = fMessenger->DeclareProperty("sampleInterval", fSampleInterval,
+        "Sample RSS, ntuple buffers and allocator pools every N events per thread (0 = off).");
+    intervalCmd.SetParameterName("N", false);
+    intervalCmd.SetRange("N>=0");
+    intervalCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& fileCmd = fMessenger->DeclareProperty("fileName", fFileName,
+        "Base name of the CSV time series (worker threads append _t<thread>).");
+    fileCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+}
+
+MemoryMonitor::~MemoryMonitor()
+{
+    delete fMessenger;
+}
+
+void MemoryMonitor::RegisterNtuple(G4int ntupleId, const G4String& name)
+{
+    if (ntupleId < 0) return;
+    if (static_cast<std::size_t>(ntupleId) >= fNtupleNames.size()) {
+        fNtupleNames.resize(ntupleId + 1);
+        fBufferedBytes.resize(ntupleId + 1, 0);
+        fPeakBufferedBytes.resize(ntupleId + 1, 0);
+        fPeakBufferedEvent.resize(ntupleId + 1, -1);
+    }
+    fNtupleNames[ntupleId] = name;
+}
+
+void MemoryMonitor::BeginOfRun(G4int runID)
+{
+    std::fill(fBufferedBytes.begin(), fBufferedBytes.end(), 0);
+    fFlushPending.store(false);
+    std::fill(fPeakBufferedBytes.begin(), fPeakBufferedBytes.end(), 0);
+    std::fill(fPeakBufferedEvent.begin(), fPeakBufferedEvent.end(), -1);
+    fPeakResidentMB = 0.;
+    fPeakResidentEvent = -1;
+    fEventsSeen = 0;
+    fStartTime = std::chrono::steady_clock::now();
+
+    if (fSampleInterval <= 0) return;
+
+    G4String fileName = fFileName;
+    if (!G4Threading::IsMasterThread()) {
+        fileName += "_t" + std::to_string(G4Threading::G4GetThreadId());
+    }
+    fileName += "_run" + std::to_string(runID) + ".csv";
+
+    fOutput.open(fileName);
+    if (!fOutput) {
+        G4Exception("MemoryMonitor::BeginOfRun", "MemoryProfileOpenError", JustWarning,
+                    ("Cannot open " + fileName + "; memory sampling disabled for this run.").c_str());
+        return;
+    }
+
+    fOutput << "EventID,Time_s,RSS_MB,TrackPool_bytes,DynamicParticlePool_bytes,AllocatorPools";
+    for (const auto& name : fNtupleNames) {
+        fOutput << ",Buffered_" << name << "_bytes";
+    }
+    fOutput << "\n";
+}
+
+void MemoryMonitor::ApplyPendingFlush()
+{
+    if (fFlushPending.exchange(false, std::memory_order_relaxed)) {
+        std::fill(fBufferedBytes.begin(), fBufferedBytes.end(), 0);
+    }
+}
+
+void MemoryMonitor::Sample(G4int eventID)
+{
+    if (fSampleInterval <= 0 || !fOutput.is_open()) return;
+    if (fEventsSeen++ % fSampleInterval != 0) return;
+
+    ApplyPendingFlush();
+
+    G4double residentMB = ReadResidentMB();
+    if (residentMB > fPeakResidentMB) {
+        fPeakResidentMB = residentMB;
+        fPeakResidentEvent = eventID;
+    }
+
+    // Pools of the calling thread; allocators are created lazily
+    G4Allocator<G4Track>* trackAllocator = aTrackAllocator();
+    G4Allocator<G4DynamicParticle>* particleAllocator = pDynamicParticleAllocator();
+    G4AllocatorList* allocators = G4AllocatorList::GetAllocatorListIfExist();
+
+    std::chrono::duration<G4double> elapsed = std::chrono::steady_clock::now() - fStartTime;
+
+    fOutput << eventID << "," << elapsed.count() << "," << residentMB
+            << "," << (trackAllocator ? trackAllocator->GetAllocatedSize() : 0)
+            << "," << (particleAllocator ? particleAllocator->GetAllocatedSize() : 0)
+            << "," << (allocators ? allocators->Size() : 0);
+
+    for (std::size_t id = 0; id < fBufferedBytes.size(); ++id) {
+        fOutput << "," << fBufferedBytes[id];
+        if (fBufferedBytes[id] > fPeakBufferedBytes[id]) {
+            fPeakBufferedBytes[id] = fBufferedBytes[id];
+            fPeakBufferedEvent[id] = eventID;
+        }
+    }
+    fOutput << "\n";
+}
+
+void MemoryMonitor::EndOfRun()
+{
+    if (!fOutput.is_open()) return;
+    fOutput.close();
+
+    G4cout << "MemoryMonitor (Thread " << G4Threading::G4GetThreadId() << "): "
+           << fEventsSeen << " events, peak RSS " << fPeakResidentMB
+           << " MB at event " << fPeakResidentEvent << G4endl;
+    for (std::size_t id = 0; id < fNtupleNames.size(); ++id) {
+        G4cout << "    ntuple " << fNtupleNames[id] << ": peak buffered "
+               << fPeakBufferedBytes[id] / 1024. << " kB at event " << fPeakBufferedEvent[id] << G4endl;
+    }
+}
+
+G4double MemoryMonitor::ReadResidentMB()
+{
+    // Linux only: second field of /proc/self/statm is the resident set in pages
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) return 0.;
+    return resident * static_cast<G4double>(sysconf(_SC_PAGESIZE)) / (1024. * 1024.);
+}
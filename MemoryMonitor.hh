@@ -0,0 +1,68 @@
+﻿#ifndef MemoryMonitor_h
+#define MemoryMonitor_h 1
+
+#include "globals.hh"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+class G4GenericMessenger;
+
+// Optional memory sampling for one thread: every N events it records the process
+// RSS, the bytes filled into each ntuple since its last Write() (what the analysis
+// manager still holds in memory) and the Geant4 allocator pools, as one CSV row.
+// The peaks and the events where they occurred are summarized at end of run.
+// Enabled with /tomography/memory/sampleInterval N (0 = off, the default).
+class MemoryMonitor
+{
+public:
+    MemoryMonitor();
+    ~MemoryMonitor();
+
+    // Called once per booked ntuple so the output columns carry its name
+    void RegisterNtuple(G4int ntupleId, const G4String& name);
+
+    void BeginOfRun(G4int runID);
+    void EndOfRun();
+
+    // Bookkeeping of the bytes handed to each ntuple, reset when the ntuples are
+    // written out (not tracked with the async writer, which has its own files)
+    void AddNtupleBytes(G4int ntupleId, std::size_t bytes)
+    {
+        if (fSampleInterval <= 0) return;
+        ApplyPendingFlush();
+        fBufferedBytes[ntupleId] += bytes;
+    }
+    void NotifyFlush() { fFlushPending.store(true, std::memory_order_relaxed); }
+
+    void Sample(G4int eventID);
+
+    G4bool IsEnabled() const { return fSampleInterval > 0; }
+
+    // Process resident set size (Linux /proc/self/statm)
+    static G4double ReadResidentMB();
+
+private:
+    void ApplyPendingFlush();
+
+    G4int fSampleInterval;
+    G4String fFileName;
+    G4GenericMessenger* fMessenger;
+
+    std::vector<G4String> fNtupleNames;
+    std::vector<std::size_t> fBufferedBytes;
+    std::atomic<G4bool> fFlushPending;
+
+    std::ofstream fOutput;
+    std::chrono::steady_clock::time_point fStartTime;
+    G4int fEventsSeen;
+
+    G4double fPeakResidentMB;
+    G4int fPeakResidentEvent;
+    std::vector<std::size_t> fPeakBufferedBytes;
+    std::vector<G4int> fPeakBufferedEvent;
+};
+
+#endif
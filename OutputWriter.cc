@@ -0,0 +1,369 @@
+﻿#include "OutputWriter.hh"
+#include "EventRecord.hh"
+#include "LiveMonitor.hh"
+
+#include "G4Version.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4ParticleDefinition.hh"
+
+#include <tools/wroot/file>
+#include <tools/wroot/ntuple>
+#if G4VERSION_NUMBER >= 1110
+#include <toolx/zlib>
+#else
+#include <tools/zlib>
+#endif
+
+#include <chrono>
+
+namespace
+{
+    std::size_t RoundUpToPowerOfTwo(std::size_t n)
+    {
+        std::size_t power = 1;
+        while (power < n) power <<= 1;
+        return power;
+    }
+}
+
+RecordRing::RecordRing(std::size_t capacity)
+ : fSlots(RoundUpToPowerOfTwo(capacity < 2 ? 2 : capacity), nullptr),
+   fMask(fSlots.size() - 1),
+   fHead(0),
+   fTail(0)
+{}
+
+G4bool RecordRing::TryPush(EventRecord* record)
+{
+    std::size_t tail = fTail.load(std::memory_order_relaxed);
+    if (tail - fHead.load(std::memory_order_acquire) == fSlots.size()) return false;
+    fSlots[tail & fMask] = record;
+    fTail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+EventRecord* RecordRing::TryPop()
+{
+    std::size_t head = fHead.load(std::memory_order_relaxed);
+    if (head == fTail.load(std::memory_order_acquire)) return nullptr;
+    EventRecord* record = fSlots[head & fMask];
+    fHead.store(head + 1, std::memory_order_release);
+    return record;
+}
+
+std::size_t RecordRing::Size() const
+{
+    return fTail.load(std::memory_order_acquire) - fHead.load(std::memory_order_acquire);
+}
+
+// The trees of one output file, with the same layout as the ones RunAction books
+// with the analysis manager. Used by one thread at a time (see OutputQueue).
+class RecordFile
+{
+public:
+    RecordFile(const G4String& fileName, G4int compressionLevel, G4bool eventIndex, std::ostream& errors);
+    ~RecordFile();
+
+    G4bool IsOpen() const { return fFile.is_open(); }
+    void Write(const EventRecord& record);
+
+private:
+    template <class T>
+    using Column = tools::wroot::ntuple::column<T>;
+
+    tools::wroot::file fFile;
+    G4long fFillErrors;
+
+    tools::wroot::ntuple* fSpectrum;
+    Column<G4int>*    fSpectrumEventID;
+    Column<G4int>*    fSpectrumCellID;
+    tools::wroot::ntuple::column_string* fSpectrumParticle;
+    Column<G4double>* fSpectrumEnergy;
+    Column<G4int>*    fSpectrumPrimaryID;
+
+    tools::wroot::ntuple* fEdep;
+    Column<G4int>*    fEdepEventID;
+    Column<G4int>*    fEdepCellID;
+    Column<G4double>* fEdepEnergy;
+    Column<G4int>*    fEdepPrimaryID;
+
+    tools::wroot::ntuple* fMuonTrack;
+    Column<G4int>*    fMuonEventID;
+    Column<G4double>* fMuonPosition[6];
+    Column<G4int>*    fMuonPrimaryID;
+
+    // Entry range of each event per tree; nullptr without /tomography/output/eventIndex
+    tools::wroot::ntuple* fIndex;
+    Column<G4int>*    fIndexEventID;
+    Column<G4double>* fIndexFirst[3];
+    Column<G4int>*    fIndexCount[3];
+    G4double fEntries[3];
+
+    std::ostream& fErrors;
+};
+
+RecordFile::RecordFile(const G4String& fileName, G4int compressionLevel, G4bool eventIndex,
+                       std::ostream& errors)
+ : fFile(errors, fileName),
+   fFillErrors(0),
+   fIndex(nullptr),
+   fEntries{0., 0., 0.},
+   fErrors(errors)
+{
+    if (!fFile.is_open()) return;
+
+#if G4VERSION_NUMBER >= 1110
+    fFile.add_ziper('Z', toolx::compress_buffer);
+#else
+    fFile.add_ziper('Z', tools::compress_buffer);
+#endif
+    fFile.set_compression(compressionLevel);
+
+    // The directory takes ownership of the ntuples
+    fSpectrum = new tools::wroot::ntuple(fFile.dir(), "SpectrumData", "Particle data (photons, etc.) reaching cell boundary");
+    fSpectrumEventID = fSpectrum->create_column<G4int>("EventID");
+    fSpectrumCellID = fSpectrum->create_column<G4int>("CellID");
+    fSpectrumParticle = fSpectrum->create_column_string("ParticleName");
+    fSpectrumEnergy = fSpectrum->create_column<G4double>("EnergyMeV");
+    fSpectrumPrimaryID = fSpectrum->create_column<G4int>("PrimaryID");
+
+    fEdep = new tools::wroot::ntuple(fFile.dir(), "EdepData", "Energy depositions in cells");
+    fEdepEventID = fEdep->create_column<G4int>("EventID");
+    fEdepCellID = fEdep->create_column<G4int>("CellID");
+    fEdepEnergy = fEdep->create_column<G4double>("EdepMeV");
+    fEdepPrimaryID = fEdep->create_column<G4int>("PrimaryID");
+
+    fMuonTrack = new tools::wroot::ntuple(fFile.dir(), "MuonTrackData", "Primary Muon Step-by-Step Trajectory");
+    fMuonEventID = fMuonTrack->create_column<G4int>("EventID");
+    const char* positionNames[6] = {"PreStepX_cm", "PreStepY_cm", "PreStepZ_cm",
+                                    "PostStepX_cm", "PostStepY_cm", "PostStepZ_cm"};
+    for (G4int i = 0; i < 6; ++i) fMuonPosition[i] = fMuonTrack->create_column<G4double>(positionNames[i]);
+    fMuonPrimaryID = fMuonTrack->create_column<G4int>("PrimaryID");
+
+    if (eventIndex) {
+        fIndex = new tools::wroot::ntuple(fFile.dir(), "EventIndex", "Entry range of each event per tree");
+        fIndexEventID = fIndex->create_column<G4int>("EventID");
+        const char* treeNames[3] = {"Edep", "Spectrum", "MuonTrack"};
+        for (G4int i = 0; i < 3; ++i) {
+            fIndexFirst[i] = fIndex->create_column<G4double>(std::string(treeNames[i]) + "First");
+            fIndexCount[i] = fIndex->create_column<G4int>(std::string(treeNames[i]) + "Count");
+        }
+    }
+}
+
+RecordFile::~RecordFile()
+{
+    if (!fFile.is_open()) return;
+
+    unsigned int nbytes = 0;
+    if (!fFile.write(nbytes)) fErrors << "final write failed. ";
+    fFile.close();
+    if (fFillErrors > 0) fErrors << fFillErrors << " rows could not be filled. ";
+}
+
+void RecordFile::Write(const EventRecord& record)
+{
+    G4bool ok = true;
+
+    for (const auto& row : record.edep) {
+        ok &= fEdepEventID->fill(record.eventID) && fEdepCellID->fill(row.cellID) &&
+              fEdepEnergy->fill(row.edep / MeV) && fEdepPrimaryID->fill(row.primaryID) && fEdep->add_row();
+    }
+
+    for (const auto& row : record.spectrum) {
+        ok &= fSpectrumEventID->fill(record.eventID) && fSpectrumCellID->fill(row.cellID) &&
+              fSpectrumParticle->fill(row.particle->GetParticleName()) &&
+              fSpectrumEnergy->fill(row.energy / MeV) && fSpectrumPrimaryID->fill(row.primaryID) &&
+              fSpectrum->add_row();
+    }
+
+    for (const auto& row : record.muonSteps) {
+        ok &= fMuonEventID->fill(record.eventID) &&
+              fMuonPosition[0]->fill(row.prePosition.x() / cm) && fMuonPosition[1]->fill(row.prePosition.y() / cm) &&
+              fMuonPosition[2]->fill(row.prePosition.z() / cm) && fMuonPosition[3]->fill(row.postPosition.x() / cm) &&
+              fMuonPosition[4]->fill(row.postPosition.y() / cm) && fMuonPosition[5]->fill(row.postPosition.z() / cm) &&
+              fMuonPrimaryID->fill(row.primaryID) && fMuonTrack->add_row();
+    }
+
+    if (fIndex) {
+        const std::size_t counts[3] = {record.edep.size(), record.spectrum.size(), record.muonSteps.size()};
+        ok &= fIndexEventID->fill(record.eventID);
+        for (G4int i = 0; i < 3; ++i) {
+            ok &= fIndexFirst[i]->fill(fEntries[i]) && fIndexCount[i]->fill(static_cast<G4int>(counts[i]));
+            fEntries[i] += counts[i];
+        }
+        ok &= fIndex->add_row();
+    }
+
+    if (!ok) ++fFillErrors;
+}
+
+OutputQueue::OutputQueue(const G4String& fileName, G4int threadId, std::size_t capacity,
+                         G4int compressionLevel, G4bool eventIndex)
+ : fThreadId(threadId),
+   fPending(capacity),
+   fFree(capacity),
+   fPushed(0),
+   fStalls(0),
+   fMaxDepth(0),
+   fFinishing(false),
+   fClosed(false)
+{
+    fFile.reset(new RecordFile(fileName, compressionLevel, eventIndex, fErrors));
+}
+
+OutputQueue::~OutputQueue()
+{
+    // Only called after Finish() and OutputWriter::Unregister(), or if the file failed to open
+    fFile.reset();
+    while (EventRecord* record = fPending.TryPop()) delete record;
+    while (EventRecord* record = fFree.TryPop()) delete record;
+}
+
+G4bool OutputQueue::IsOpen() const
+{
+    return fFile && fFile->IsOpen();
+}
+
+EventRecord* OutputQueue::Acquire()
+{
+    EventRecord* record = fFree.TryPop();
+    return record ? record : new EventRecord;
+}
+
+void OutputQueue::Push(EventRecord* record)
+{
+    // Back-pressure: the simulation thread waits for the writer to catch up
+    if (!fPending.TryPush(record)) {
+        ++fStalls;
+        while (!fPending.TryPush(record)) {
+            std::this_thread::yield();
+        }
+    }
+    ++fPushed;
+
+    std::size_t depth = fPending.Size();
+    if (depth > fMaxDepth) fMaxDepth = depth;
+}
+
+void OutputQueue::Finish()
+{
+    // Every Push() happens before this store, so once the writer sees it, an
+    // empty fPending means that all records were written
+    fFinishing.store(true, std::memory_order_release);
+    while (!fClosed.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+G4bool OutputQueue::WriteNext()
+{
+    if (fClosed.load(std::memory_order_relaxed)) return false;
+
+    G4bool finishing = fFinishing.load(std::memory_order_acquire);
+    EventRecord* record = fPending.TryPop();
+    if (!record) {
+        if (finishing) Close();
+        return false;
+    }
+
+    fFile->Write(*record);
+
+    LiveMonitor& liveMonitor = LiveMonitor::Instance();
+    if (liveMonitor.IsPublishing()) {
+        liveMonitor.AddOutputBytes(record->GetEdepBytes() + record->GetSpectrumBytes() + record->GetMuonStepBytes(),
+                                   fThreadId);
+    }
+
+    if (!fFree.TryPush(record)) delete record;
+    return true;
+}
+
+void OutputQueue::Close()
+{
+    // Final basket writes and compression stay on the writer thread
+    fFile.reset();
+    fClosed.store(true, std::memory_order_release);
+}
+
+OutputWriter& OutputWriter::Instance()
+{
+    static OutputWriter instance;
+    return instance;
+}
+
+OutputWriter::OutputWriter()
+ : fStop(false)
+{}
+
+OutputWriter::~OutputWriter()
+{
+    fStop.store(true);
+    if (fThread.joinable()) fThread.join();
+}
+
+void OutputWriter::Register(const std::shared_ptr<OutputQueue>& queue)
+{
+    std::lock_guard<std::mutex> lifecycleLock(fLifecycleMutex);
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fQueues.push_back(queue);
+    }
+    if (!fThread.joinable()) {
+        fStop.store(false);
+        fThread = std::thread(&OutputWriter::Loop, this);
+    }
+}
+
+void OutputWriter::Unregister(const OutputQueue* queue)
+{
+    std::lock_guard<std::mutex> lifecycleLock(fLifecycleMutex);
+    G4bool last = false;
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        for (auto it = fQueues.begin(); it != fQueues.end(); ++it) {
+            if (it->get() == queue) {
+                fQueues.erase(it);
+                break;
+            }
+        }
+        last = fQueues.empty();
+    }
+    if (last && fThread.joinable()) {
+        fStop.store(true);
+        fThread.join();
+    }
+}
+
+void OutputWriter::Loop()
+{
+    // Records per queue before moving to the next one, to stay fair between workers
+    const G4int batchSize = 16;
+    auto idleSleep = std::chrono::microseconds(50);
+
+    // Filled and written without the registry lock, so that Register() and
+    // Unregister() at begin and end of run never wait for file I/O
+    std::vector<std::shared_ptr<OutputQueue>> queues;
+
+    while (!fStop.load()) {
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            queues = fQueues;
+        }
+
+        G4bool wrote = false;
+        for (const auto& queue : queues) {
+            for (G4int n = 0; n < batchSize && queue->WriteNext(); ++n) {
+                wrote = true;
+            }
+        }
+        queues.clear();
+
+        if (wrote) {
+            idleSleep = std::chrono::microseconds(50);
+        } else {
+            std::this_thread::sleep_for(idleSleep);
+            if (idleSleep < std::chrono::milliseconds(2)) idleSleep *= 2;
+        }
+    }
+}
@@ -0,0 +1,115 @@
+﻿#ifndef OutputWriter_h
+#define OutputWriter_h 1
+
+#include "globals.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+struct EventRecord;
+class RecordFile;
+
+// Bounded single-producer/single-consumer ring of records, lock-free.
+class RecordRing
+{
+public:
+    explicit RecordRing(std::size_t capacity);
+
+    G4bool TryPush(EventRecord* record);
+    EventRecord* TryPop();
+    std::size_t Size() const;
+
+private:
+    std::vector<EventRecord*> fSlots;
+    std::size_t fMask;
+    alignas(64) std::atomic<std::size_t> fHead;
+    alignas(64) std::atomic<std::size_t> fTail;
+};
+
+// Hand-off between one simulation thread and the writer thread. Completed
+// records travel through fPending; the writer returns emptied records through
+// fFree so that steady-state running does not allocate.
+//
+// The queue owns its own ROOT file, written with g4tools directly: the Geant4
+// analysis manager (thread-local, and merged into the master's ntuples) is never
+// used by the writer thread. The simulation thread opens the file before
+// registering the queue; from OutputWriter::Register() on, only the writer thread
+// touches it (the registry mutex orders the two), and the writer closes it after
+// the last record once Finish() was called. Finish() synchronizes with that close
+// through fClosed, so the statistics and errors may be read afterwards.
+class OutputQueue
+{
+public:
+    // Opens fileName (e.g. tomography_output_t3.root); check IsOpen()
+    OutputQueue(const G4String& fileName, G4int threadId, std::size_t capacity,
+                G4int compressionLevel, G4bool eventIndex);
+    ~OutputQueue();
+
+    G4bool IsOpen() const;
+
+    // Simulation thread
+    EventRecord* Acquire();
+    void Push(EventRecord* record); // waits for a free slot when the queue is full
+    void Finish();                  // waits until every pushed record is written and the file closed
+
+    // Writer thread
+    G4bool WriteNext();
+
+    std::size_t GetDepth() const { return fPending.Size(); }
+    std::size_t GetMaxDepth() const { return fMaxDepth; }
+    G4long GetStalls() const { return fStalls; }
+
+    // After Finish(): messages from the file writer (empty when all went well)
+    G4String GetErrors() const { return fErrors.str(); }
+
+private:
+    void Close();
+
+    G4int fThreadId; // of the simulation thread, for the live monitor slot
+
+    RecordRing fPending;
+    RecordRing fFree;
+
+    std::unique_ptr<RecordFile> fFile;
+    std::ostringstream fErrors;
+
+    G4long fPushed;
+    G4long fStalls;
+    std::size_t fMaxDepth;
+    std::atomic<G4bool> fFinishing;
+    std::atomic<G4bool> fClosed;
+};
+
+// Process-wide writer thread: fills the ntuples and does the compressed writes
+// for every registered queue, so that the simulation threads only pay for moving
+// a record pointer. It makes no Geant4 kernel or analysis manager calls. Runs
+// while at least one queue is registered.
+class OutputWriter
+{
+public:
+    static OutputWriter& Instance();
+
+    // The writer keeps a reference while it services a queue, so an unregistered
+    // queue lives until the writer's current pass over the queues is over
+    void Register(const std::shared_ptr<OutputQueue>& queue);
+    void Unregister(const OutputQueue* queue);
+
+private:
+    OutputWriter();
+    ~OutputWriter();
+
+    void Loop();
+
+    std::mutex fLifecycleMutex; // serializes starting and stopping the thread
+    std::mutex fMutex;          // guards fQueues; never held during file I/O
+    std::vector<std::shared_ptr<OutputQueue>> fQueues;
+    std::thread fThread;
+    std::atomic<G4bool> fStop;
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "PrimaryGeneratorAction.hh"
+#include "EventSeeder.hh"
+#include "ShowerLibrary.hh"
 
 #include "G4LogicalVolumeStore.hh"
 #include "G4LogicalVolume.hh"
@@ -7,14 +9,27 @@
 #include "G4ParticleGun.hh"
 #include "G4ParticleTable.hh"
 #include "G4ParticleDefinition.hh"
+#include "G4IonTable.hh"
+#include "G4PrimaryParticle.hh"
+#include "G4PrimaryVertex.hh"
+#include "G4GenericMessenger.hh"
 #include "G4SystemOfUnits.hh"
 #include "G4PhysicalConstants.hh"
 #include "Randomize.hh"
+#include "G4Poisson.hh"
 
 PrimaryGeneratorAction::PrimaryGeneratorAction()
  : G4VUserPrimaryGeneratorAction(),
    fParticleGun(nullptr),
-   fEnvelopeBox(nullptr)
+   fEnvelopeBox(nullptr),
+   fMode("gun"),
+   fPileupRate(0.),
+   fReadoutWindow(1.*microsecond),
+   fReplayAccess("sequential"),
+   fShardIndex(0),
+   fShardCount(1),
+   fSkippedParticles(0),
+   fMessenger(nullptr)
 {
     G4int n_particle = 1;
     fParticleGun = new G4ParticleGun(n_particle);
@@ -26,17 +41,167 @@ PrimaryGeneratorAction::PrimaryGeneratorAction()
     fParticleGun->SetParticleDefinition(particle);
     fParticleGun->SetParticleMomentumDirection(G4ThreeVector(0.,0.,-1.));
     fParticleGun->SetParticleEnergy(4.*GeV);
+
+    DefineCommands();
 }
 
 PrimaryGeneratorAction::~PrimaryGeneratorAction()
 {
+    if (fSkippedParticles > 0) {
+        G4cout << "PrimaryGeneratorAction: skipped " << fSkippedParticles
+               << " library particles with unknown PDG codes." << G4endl;
+    }
+    delete fMessenger;
     delete fParticleGun;
 }
 
+void PrimaryGeneratorAction::DefineCommands()
+{
+    fMessenger = new G4GenericMessenger(this, "/tomography/gun/", "Primary generator");
+
+    auto& modeCmd = fMessenger->DeclareProperty("mode", fMode,
+        "gun: parametrized cosmic muon; replay: events from a precomputed shower library.");
+    modeCmd.SetParameterName("mode", false);
+    modeCmd.SetCandidates("gun replay");
+    modeCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& rateCmd = fMessenger->DeclarePropertyWithUnit("pileupRate", "hertz", fPileupRate,
+        "Muon rate for pile-up: each event is one readout window with a Poisson number of muons (0 = one muon).");
+    rateCmd.SetParameterName("rate", false);
+    rateCmd.SetRange("rate>=0.");
+    rateCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& windowCmd = fMessenger->DeclarePropertyWithUnit("readoutWindow", "ns", fReadoutWindow,
+        "Length of the readout window over which pile-up muon start times are spread.");
+    windowCmd.SetParameterName("window", false);
+    windowCmd.SetRange("window>0.");
+    windowCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& fileCmd = fMessenger->DeclareProperty("replayFile", fReplayFile,
+        "Shower library to replay (see make_shower_library.py); memory-mapped, shared by all threads.");
+    fileCmd.SetParameterName("file", false);
+    fileCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& accessCmd = fMessenger->DeclareProperty("replayAccess", fReplayAccess,
+        "sequential: library event = EventID modulo the shard size; random: drawn uniformly per event.");
+    accessCmd.SetParameterName("access", false);
+    accessCmd.SetCandidates("sequential random");
+    accessCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& shardIndexCmd = fMessenger->DeclareProperty("shardIndex", fShardIndex,
+        "Replay only shard i of shardCount equal, contiguous slices of the library.");
+    shardIndexCmd.SetParameterName("i", false);
+    shardIndexCmd.SetRange("i>=0");
+    shardIndexCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& shardCountCmd = fMessenger->DeclareProperty("shardCount", fShardCount,
+        "Number of slices the library is split into, e.g. one per farm job.");
+    shardCountCmd.SetParameterName("n", false);
+    shardCountCmd.SetRange("n>0");
+    shardCountCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& offsetCmd = fMessenger->DeclarePropertyWithUnit("replayOffset", "cm", fReplayOffset,
+        "Shift added to every library vertex position.");
+    offsetCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+}
+
+void PrimaryGeneratorAction::OpenLibrary()
+{
+    if (fReplayFile.empty()) {
+        G4Exception("PrimaryGeneratorAction::OpenLibrary()", "NoReplayFile",
+                    FatalException, "Replay mode requires /tomography/gun/replayFile.");
+        return;
+    }
+    if (fShardIndex >= fShardCount) {
+        G4Exception("PrimaryGeneratorAction::OpenLibrary()", "InvalidShard",
+                    FatalException, "/tomography/gun/shardIndex must be smaller than shardCount.");
+        return;
+    }
+
+    if (!fLibrary || fLibrary->GetFileName() != fReplayFile) {
+        fLibrary = ShowerLibrary::Open(fReplayFile);
+        fLibraryAccess.clear();
+    }
+    if (fLibraryAccess != fReplayAccess) {
+        fLibrary->AdviseAccess(fReplayAccess == "sequential");
+        fLibraryAccess = fReplayAccess;
+    }
+    if (fLibrary->GetNumberOfEvents() < static_cast<std::uint64_t>(fShardCount)) {
+        G4Exception("PrimaryGeneratorAction::OpenLibrary()", "InvalidShard",
+                    FatalException, "Shower library has fewer events than shards.");
+    }
+}
+
+void PrimaryGeneratorAction::GenerateFromLibrary(G4Event* anEvent)
+{
+    OpenLibrary();
+
+    // Shard boundaries, computed so that the shards cover the library exactly
+    std::uint64_t nEvents = fLibrary->GetNumberOfEvents();
+    std::uint64_t first = nEvents * fShardIndex / fShardCount;
+    std::uint64_t shardSize = nEvents * (fShardIndex + 1) / fShardCount - first;
+
+    // EventIDs are unique across worker threads, so sequential replay covers the
+    // shard once (in any thread order) before it wraps around
+    std::uint64_t entry;
+    if (fReplayAccess == "sequential") {
+        entry = first + static_cast<std::uint64_t>(anEvent->GetEventID()) % shardSize;
+    } else {
+        entry = first + static_cast<std::uint64_t>(G4UniformRand() * shardSize);
+        if (entry >= first + shardSize) entry = first + shardSize - 1;
+    }
+
+    G4ParticleTable* particleTable = G4ParticleTable::GetParticleTable();
+    const ShowerLibrary::Particle* particles = fLibrary->GetParticles(entry);
+    std::uint64_t nParticles = fLibrary->GetNumberOfParticles(entry);
+
+    for (std::uint64_t i = 0; i < nParticles; ++i) {
+        const ShowerLibrary::Particle& p = particles[i];
+
+        G4ParticleDefinition* definition = particleTable->FindParticle(p.pdgCode);
+        if (!definition && p.pdgCode > 1000000000) {
+            definition = G4IonTable::GetIonTable()->GetIon(p.pdgCode);
+        }
+        if (!definition) {
+            ++fSkippedParticles;
+            continue;
+        }
+
+        G4ThreeVector position = G4ThreeVector(p.x * mm, p.y * mm, p.z * mm) + fReplayOffset;
+        auto* vertex = new G4PrimaryVertex(position, p.t * ns);
+        vertex->SetPrimary(new G4PrimaryParticle(definition, p.px * MeV, p.py * MeV, p.pz * MeV));
+        anEvent->AddPrimaryVertex(vertex);
+    }
+}
+
 void PrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
 {
     // This function is called at the beginning of each event
 
+    // Everything drawn for this event follows from (run seed, EventID) only
+    if (EventSeeder::IsEnabled()) {
+        EventSeeder::SeedEvent(anEvent->GetEventID());
+    }
+
+    if (fMode == "replay") {
+        GenerateFromLibrary(anEvent);
+        return;
+    }
+
+    if (fPileupRate <= 0.) {
+        GenerateMuon(anEvent, 0.);
+        return;
+    }
+
+    // Pile-up: the event is one readout window, which may also contain no muon at all
+    G4long nofMuons = G4Poisson(fPileupRate * fReadoutWindow);
+    for (G4long i = 0; i < nofMuons; ++i) {
+        GenerateMuon(anEvent, G4UniformRand() * fReadoutWindow);
+    }
+}
+
+void PrimaryGeneratorAction::GenerateMuon(G4Event* anEvent, G4double time)
+{
     // Generate cosmic muons with realistic angular distribution
     G4double theta = G4RandGauss::shoot(0., 0.1); // Small angular spread
     if (theta > 0.5) theta = 0.5; // Limit maximum angle
@@ -59,5 +224,6 @@ void PrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
     G4double z0 = 50.*cm; // Start above the detector
     
     fParticleGun->SetParticlePosition(G4ThreeVector(x0, y0, z0));
+    fParticleGun->SetParticleTime(time);
     fParticleGun->GeneratePrimaryVertex(anEvent);
 }
@@ -3,11 +3,16 @@
 
 #include "G4VUserPrimaryGeneratorAction.hh"
 #include "G4ParticleGun.hh"
+#include "G4ThreeVector.hh"
 #include "globals.hh"
 
+#include <memory>
+
 class G4ParticleGun;
 class G4Event;
 class G4Box;
+class G4GenericMessenger;
+class ShowerLibrary;
 
 class PrimaryGeneratorAction : public G4VUserPrimaryGeneratorAction
 {
@@ -20,8 +25,38 @@ public:
     const G4ParticleGun* GetParticleGun() const { return fParticleGun; }
 
 private:
+    void DefineCommands();
+
+    // One cosmic muon from the parametrized distribution, starting at the given time
+    void GenerateMuon(G4Event* anEvent, G4double time);
+
+    // Replay mode: one library event per G4Event, read in place from the mapping
+    void GenerateFromLibrary(G4Event* anEvent);
+    void OpenLibrary();
+
     G4ParticleGun* fParticleGun;
     G4Box* fEnvelopeBox;
+
+    // Source of primaries: "gun" (parametrized cosmic muon) or "replay"
+    G4String fMode;
+
+    // Pile-up (gun mode): Poisson number of muons with mean rate x window, each at a
+    // uniformly distributed time in the readout window. Off while the rate is 0.
+    G4double fPileupRate;
+    G4double fReadoutWindow;
+
+    // Replay settings
+    G4String fReplayFile;
+    G4String fReplayAccess;   // "sequential" (by EventID) or "random"
+    G4int fShardIndex;
+    G4int fShardCount;
+    G4ThreeVector fReplayOffset;
+
+    std::shared_ptr<const ShowerLibrary> fLibrary;
+    G4String fLibraryAccess;  // access pattern the mapping was last advised for
+    G4int fSkippedParticles;
+
+    G4GenericMessenger* fMessenger;
 };
 
 #endif
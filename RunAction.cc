@@ -1,10 +1,20 @@
 ﻿#include "RunAction.hh"
+#include "DetectorConstruction.hh"
+#include "EventSeeder.hh"
+#include "MemoryMonitor.hh"
+#include "EventRecord.hh"
+#include "OutputWriter.hh"
+#include "LiveMonitor.hh"
+#include "InferenceStream.hh"
 #include "G4RunManager.hh"
+#include "G4Version.hh"
 #include "G4Run.hh"
 #include "G4AccumulableManager.hh"
+#include "G4GenericMessenger.hh"
 #include "G4UnitsTable.hh"
 #include "G4SystemOfUnits.hh"
 #include "G4Threading.hh"
+#include "G4ParticleDefinition.hh"
 
 // For ROOT output
 #include "G4RootAnalysisManager.hh"
@@ -14,15 +24,42 @@ RunAction::RunAction()
  : G4UserRunAction(),
    fEdep("Edep", 0.),
    fEdep2("Edep2", 0.),
+   fTriggerAccepted("TriggerAccepted", 0),
+   fTriggerRejected("TriggerRejected", 0),
+   fTriggerAcceptedCpu("TriggerAcceptedCpu", 0.),
+   fHistogramMode(false),
+   fEventIndex(false),
+   fFileOutput(true),
+   fBooked(false),
+   fBookedEventIndex(false),
+   fBookedAsyncWriter(false),
+   fEdepEntries(0.),
+   fSpectrumEntries(0.),
+   fMuonTrackEntries(0.),
+   fAsyncWriter(false),
+   fQueueCapacity(256),
+   fRunSeed(0),
+   fPerEventSeeding(true),
    fSpectrumNtupleId(-1),
    fEdepNtupleId(-1),
    fMuonTrackNtupleId(-1),
-   fAnalysisManager(nullptr)
+   fEventIndexNtupleId(-1),
+   fCellLightH1Id(-1),
+   fCellEdepH1Id(-1),
+   fPlaneMultiplicityH1Id(-1),
+   fPlaneLightMapH2Id(-1),
+   fAnalysisManager(nullptr),
+   fMemoryMonitor(new MemoryMonitor),
+   fMessenger(nullptr),
+   fRandomMessenger(nullptr)
 {
     // Register thread-local accumulables
     G4AccumulableManager* accumulableManager = G4AccumulableManager::Instance();
     accumulableManager->RegisterAccumulable(fEdep);
     accumulableManager->RegisterAccumulable(fEdep2);
+    accumulableManager->RegisterAccumulable(fTriggerAccepted);
+    accumulableManager->RegisterAccumulable(fTriggerRejected);
+    accumulableManager->RegisterAccumulable(fTriggerAcceptedCpu);
 
     // Get the ROOT analysis manager instance
     G4RootAnalysisManager* analysisManager = G4RootAnalysisManager::Instance();
@@ -30,7 +67,7 @@ RunAction::RunAction()
     analysisManager->SetVerboseLevel(1);
 
     analysisManager->SetNtupleMerging(true);
-    
+
     // Set compression level to reduce file size
     analysisManager->SetCompressionLevel(1);
 
@@ -41,23 +78,98 @@ RunAction::RunAction()
                << analysisManager->GetFileName() << G4endl;
     }
 
+    // The live monitor's and the stream's commands belong to the master UI
+    if (G4Threading::IsMasterThread()) {
+        LiveMonitor::Instance();
+        InferenceStream::Instance();
+    }
+
+    // Booking is deferred to the first BeginOfRunAction so that the output mode
+    // can still be chosen from the macro
+    DefineCommands();
+}
+
+RunAction::~RunAction()
+{
+    delete fMessenger;
+    delete fRandomMessenger;
+    delete fMemoryMonitor;
+}
+
+void RunAction::DefineCommands()
+{
+    fMessenger = new G4GenericMessenger(this, "/tomography/output/", "Output control");
+
+    auto& histogramModeCmd = fMessenger->DeclareProperty("histogramMode", fHistogramMode,
+        "Calibration run: book per-cell and per-plane histograms instead of the ntuples.");
+    histogramModeCmd.SetParameterName("flag", true);
+    histogramModeCmd.SetDefaultValue("true");
+    histogramModeCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& eventIndexCmd = fMessenger->DeclareProperty("eventIndex", fEventIndex,
+        "Write an EventIndex ntuple (first entry and row count per tree for each event). "
+        "Disables ntuple merging: each thread writes its own file.");
+    eventIndexCmd.SetParameterName("flag", true);
+    eventIndexCmd.SetDefaultValue("true");
+    eventIndexCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& fileOutputCmd = fMessenger->DeclareProperty("fileOutput", fFileOutput,
+        "Write the ROOT file; set false to feed only /tomography/stream/ consumers.");
+    fileOutputCmd.SetParameterName("flag", true);
+    fileOutputCmd.SetDefaultValue("true");
+    fileOutputCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& asyncWriterCmd = fMessenger->DeclareProperty("asyncWriter", fAsyncWriter,
+        "Fill and write the trees on a dedicated writer thread, one file per simulation thread.");
+    asyncWriterCmd.SetParameterName("flag", true);
+    asyncWriterCmd.SetDefaultValue("true");
+    asyncWriterCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& queueCapacityCmd = fMessenger->DeclareProperty("queueCapacity", fQueueCapacity,
+        "Completed events each simulation thread may queue for the writer before it waits.");
+    queueCapacityCmd.SetParameterName("events", false);
+    queueCapacityCmd.SetRange("events>0");
+    queueCapacityCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    fRandomMessenger = new G4GenericMessenger(this, "/tomography/random/", "Per-event random seeding");
+
+    auto& runSeedCmd = fRandomMessenger->DeclareProperty("runSeed", fRunSeed,
+        "Run seed combined with the EventID to seed each event (0 = derive from /random/setSeeds).");
+    runSeedCmd.SetParameterName("seed", false);
+    runSeedCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    auto& perEventCmd = fRandomMessenger->DeclareProperty("perEventSeeding", fPerEventSeeding,
+        "Reseed the engine from (run seed, EventID) at the start of every event.");
+    perEventCmd.SetParameterName("flag", true);
+    perEventCmd.SetDefaultValue("true");
+    perEventCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+}
+
+void RunAction::BookNtuples()
+{
+    G4RootAnalysisManager* analysisManager = fAnalysisManager;
+
     // IMPORTANT: Create smaller buffer sizes for ntuples to force more frequent writes
     // This helps prevent memory overflow
-    
+
     // Ntuple for SpectrumData (Photon Data)
     fSpectrumNtupleId = analysisManager->CreateNtuple("SpectrumData", "Particle data (photons, etc.) reaching cell boundary");
     analysisManager->CreateNtupleIColumn("EventID");
     analysisManager->CreateNtupleIColumn("CellID");
     analysisManager->CreateNtupleSColumn("ParticleName");
     analysisManager->CreateNtupleDColumn("EnergyMeV");
+    analysisManager->CreateNtupleIColumn("PrimaryID");
     analysisManager->FinishNtuple();
+    fMemoryMonitor->RegisterNtuple(fSpectrumNtupleId, "SpectrumData");
 
     // Ntuple for EdepData
     fEdepNtupleId = analysisManager->CreateNtuple("EdepData", "Energy depositions in cells");
     analysisManager->CreateNtupleIColumn("EventID");
     analysisManager->CreateNtupleIColumn("CellID");
     analysisManager->CreateNtupleDColumn("EdepMeV");
+    analysisManager->CreateNtupleIColumn("PrimaryID");
     analysisManager->FinishNtuple();
+    fMemoryMonitor->RegisterNtuple(fEdepNtupleId, "EdepData");
 
     // Ntuple for True Muon Trajectory Data
     fMuonTrackNtupleId = analysisManager->CreateNtuple("MuonTrackData", "Primary Muon Step-by-Step Trajectory");
@@ -68,21 +180,85 @@ RunAction::RunAction()
     analysisManager->CreateNtupleDColumn("PostStepX_cm");
     analysisManager->CreateNtupleDColumn("PostStepY_cm");
     analysisManager->CreateNtupleDColumn("PostStepZ_cm");
+    analysisManager->CreateNtupleIColumn("PrimaryID");
     analysisManager->FinishNtuple();
+    fMemoryMonitor->RegisterNtuple(fMuonTrackNtupleId, "MuonTrackData");
 
-    // Activate the manager
-    analysisManager->SetActivation(true);
+    // Event index: where each event's rows are in the trees above. Entry numbers are
+    // doubles (exact up to 2^53) as the ntuple interface has no 64-bit integer column.
+    if (fEventIndex) {
+        fEventIndexNtupleId = analysisManager->CreateNtuple("EventIndex", "Entry range of each event per tree");
+        analysisManager->CreateNtupleIColumn("EventID");
+        analysisManager->CreateNtupleDColumn("EdepFirst");
+        analysisManager->CreateNtupleIColumn("EdepCount");
+        analysisManager->CreateNtupleDColumn("SpectrumFirst");
+        analysisManager->CreateNtupleIColumn("SpectrumCount");
+        analysisManager->CreateNtupleDColumn("MuonTrackFirst");
+        analysisManager->CreateNtupleIColumn("MuonTrackCount");
+        analysisManager->FinishNtuple();
+    }
+
+    if (fSpectrumNtupleId < 0 || fEdepNtupleId < 0 || fMuonTrackNtupleId < 0) {
+        G4String errMsg = "One or more NTuple IDs were not properly set. IDs are: Spectrum=" +
+                          std::to_string(fSpectrumNtupleId) + ", Edep=" + std::to_string(fEdepNtupleId) +
+                          ", MuonTrack=" + std::to_string(fMuonTrackNtupleId);
+        G4Exception("RunAction::BookNtuples()", "InvalidNtupleIDs", FatalException, errMsg);
+    }
 
     G4cout << "RunAction (Thread " << G4Threading::G4GetThreadId()
-           << "): Ntuples defined and manager activated. Filename: "
-           << analysisManager->GetFileName() 
-           << " | NTuple IDs: Spectrum=" << fSpectrumNtupleId 
-           << ", Edep=" << fEdepNtupleId 
+           << "): Ntuples defined. NTuple IDs: Spectrum=" << fSpectrumNtupleId
+           << ", Edep=" << fEdepNtupleId
            << ", MuonTrack=" << fMuonTrackNtupleId << G4endl;
 }
 
-RunAction::~RunAction()
+void RunAction::BookHistograms()
 {
+    G4RootAnalysisManager* analysisManager = fAnalysisManager;
+
+    // Binning can be changed from the macro with /analysis/h1/set and /analysis/h2/set
+    const G4int nofCells = DetectorConstruction::kNofCells;
+    const G4int nofPlanes = DetectorConstruction::kNofPlanes;
+    const G4int nofCellsPerSide = DetectorConstruction::kNofCellsPerSide;
+    const G4int nofCellsPerPlane = DetectorConstruction::kNofCellsPerPlane;
+
+    // Light yield: optical photons reaching the cell boundary per event
+    for (G4int cellID = 0; cellID < nofCells; ++cellID) {
+        G4int id = analysisManager->CreateH1("CellLightYield_" + std::to_string(cellID),
+                                             "Optical photons per event in cell " + std::to_string(cellID),
+                                             200, 0., 10000.);
+        if (cellID == 0) fCellLightH1Id = id;
+    }
+
+    // Energy deposit per event
+    for (G4int cellID = 0; cellID < nofCells; ++cellID) {
+        G4int id = analysisManager->CreateH1("CellEdep_" + std::to_string(cellID),
+                                             "Energy deposit per event in cell " + std::to_string(cellID),
+                                             200, 0., 10.*MeV, "MeV");
+        if (cellID == 0) fCellEdepH1Id = id;
+    }
+
+    // Number of cells with energy deposit per event
+    for (G4int plane = 0; plane < nofPlanes; ++plane) {
+        G4int id = analysisManager->CreateH1("PlaneHitMultiplicity_" + std::to_string(plane),
+                                             "Hit cells per event in plane " + std::to_string(plane),
+                                             nofCellsPerPlane + 1, -0.5, nofCellsPerPlane + 0.5);
+        if (plane == 0) fPlaneMultiplicityH1Id = id;
+    }
+
+    // Light map over the cell grid (column = x index, row = y index)
+    for (G4int plane = 0; plane < nofPlanes; ++plane) {
+        G4int id = analysisManager->CreateH2("PlaneLightMap_" + std::to_string(plane),
+                                             "Optical photons per cell in plane " + std::to_string(plane),
+                                             nofCellsPerSide, 0., nofCellsPerSide,
+                                             nofCellsPerSide, 0., nofCellsPerSide);
+        if (plane == 0) fPlaneLightMapH2Id = id;
+    }
+
+    G4cout << "RunAction (Thread " << G4Threading::G4GetThreadId()
+           << "): Calibration histograms defined. First IDs: CellLightYield=" << fCellLightH1Id
+           << ", CellEdep=" << fCellEdepH1Id
+           << ", PlaneHitMultiplicity=" << fPlaneMultiplicityH1Id
+           << ", PlaneLightMap=" << fPlaneLightMapH2Id << G4endl;
 }
 
 void RunAction::BeginOfRunAction(const G4Run* aRun)
@@ -93,16 +269,190 @@ void RunAction::BeginOfRunAction(const G4Run* aRun)
     G4AccumulableManager* accumulableManager = G4AccumulableManager::Instance();
     accumulableManager->Reset();
 
-    // Open ROOT file
+    // The master fixes the run seed before any worker generates an event
+    if (G4Threading::IsMasterThread()) {
+        EventSeeder::SetEnabled(fPerEventSeeding);
+        EventSeeder::SetRunSeed(fRunSeed != 0 ? fRunSeed : EventSeeder::RunSeedFromEngine());
+        EventSeeder::SetRunID(aRun->GetRunID());
+        if (fPerEventSeeding) {
+            G4cout << "RunAction (Master): per-event seeding from run seed "
+                   << EventSeeder::GetRunSeed() << ", run ID " << aRun->GetRunID()
+                   << " and EventID." << G4endl;
+        }
+        LiveMonitor::Instance().BeginOfRun(aRun->GetRunID(), aRun->GetNumberOfEventToBeProcessed());
+        InferenceStream::Instance().BeginOfRun();
+    }
+
     G4RootAnalysisManager* analysisManager = G4RootAnalysisManager::Instance();
-    if (!analysisManager->OpenFile()) {
-        G4Exception("RunAction::BeginOfRunAction",
-                    "AnalysisFileOpenError", FatalException,
-                    "Failed to open ROOT analysis file");
+
+    // Book once per thread; ntuples are not created at all in histogram mode
+    if (!fBooked) {
+        if (fHistogramMode) {
+            BookHistograms();
+        } else {
+            // Entry numbers counted by this thread only match a file it writes itself
+            if (fEventIndex) analysisManager->SetNtupleMerging(false);
+            // The async writer books the same trees in its own files
+            if (!fAsyncWriter) BookNtuples();
+        }
+        analysisManager->SetActivation(true);
+        fBooked = true;
+        fBookedEventIndex = fEventIndex;
+        fBookedAsyncWriter = fAsyncWriter;
+    } else if (fHistogramMode != (fCellLightH1Id >= 0)) {
+        G4Exception("RunAction::BeginOfRunAction", "OutputModeLocked", JustWarning,
+                    "/tomography/output/histogramMode cannot change after the first run; keeping the booked output.");
+        fHistogramMode = (fCellLightH1Id >= 0);
+    }
+    if (fBooked && !fHistogramMode && fEventIndex != fBookedEventIndex) {
+        G4Exception("RunAction::BeginOfRunAction", "OutputModeLocked", JustWarning,
+                    "/tomography/output/eventIndex cannot change after the first run; keeping the booked output.");
+        fEventIndex = fBookedEventIndex;
+    }
+    if (fBooked && !fHistogramMode && fAsyncWriter != fBookedAsyncWriter) {
+        G4Exception("RunAction::BeginOfRunAction", "OutputModeLocked", JustWarning,
+                    "/tomography/output/asyncWriter cannot change after the first run; keeping the booked output.");
+        fAsyncWriter = fBookedAsyncWriter;
+    }
+
+    // Open ROOT file
+    if (UsesAnalysisFile()) {
+        if (!analysisManager->OpenFile()) {
+            G4Exception("RunAction::BeginOfRunAction",
+                        "AnalysisFileOpenError", FatalException,
+                        "Failed to open ROOT analysis file");
+        }
+        G4cout << "RunAction (Thread " << G4Threading::G4GetThreadId()
+               << "): Called OpenFile. Effective filename for manager: "
+               << analysisManager->GetFileName() << ".root" << G4endl;
+    }
+
+    fMemoryMonitor->BeginOfRun(aRun->GetRunID());
+
+    // Each run writes a new file
+    fEdepEntries = 0.;
+    fSpectrumEntries = 0.;
+    fMuonTrackEntries = 0.;
+
+    // Only threads that simulate events feed the writer (not the MT master). In
+    // sub-event parallel mode the master runs the event loop and writes the output.
+    G4bool simulatesEvents = G4Threading::IsWorkerThread() || !G4Threading::IsMultithreadedApplication();
+#if G4VERSION_NUMBER >= 1120
+    G4RunManager::RMType runManagerType = G4RunManager::GetRunManager()->GetRunManagerType();
+    if (runManagerType == G4RunManager::subEventMasterRM) simulatesEvents = true;
+    if (runManagerType == G4RunManager::subEventWorkerRM) simulatesEvents = false;
+#endif
+    if (fAsyncWriter && fFileOutput && !fHistogramMode && simulatesEvents) {
+        G4String fileName = GetWriterFileName();
+        fOutputQueue = std::make_shared<OutputQueue>(fileName, G4Threading::G4GetThreadId(), fQueueCapacity,
+                                       analysisManager->GetCompressionLevel(), fEventIndex);
+        if (!fOutputQueue->IsOpen()) {
+            G4String errMsg = "Failed to open " + fileName + " for the writer thread: " + fOutputQueue->GetErrors();
+            fOutputQueue.reset();
+            G4Exception("RunAction::BeginOfRunAction", "AnalysisFileOpenError", FatalException, errMsg);
+            return;
+        }
+        // From here on the file belongs to the writer thread
+        OutputWriter::Instance().Register(fOutputQueue);
+        G4cout << "RunAction (Thread " << G4Threading::G4GetThreadId()
+               << "): writer thread output file " << fileName << G4endl;
+    }
+}
+
+G4String RunAction::GetWriterFileName() const
+{
+    // Same naming as the analysis manager's per-thread files without ntuple merging
+    G4String fileName = fAnalysisManager->GetFileName();
+    if (fileName.size() > 5 && fileName.substr(fileName.size() - 5) == ".root") {
+        fileName = fileName.substr(0, fileName.size() - 5);
+    }
+    if (G4Threading::IsWorkerThread()) {
+        fileName += "_t" + std::to_string(G4Threading::G4GetThreadId());
+    }
+    return fileName + ".root";
+}
+
+void RunAction::WriteEventRecord(const EventRecord& record)
+{
+    G4RootAnalysisManager* analysisManager = fAnalysisManager;
+
+    for (const auto& row : record.edep) {
+        analysisManager->FillNtupleIColumn(fEdepNtupleId, 0, record.eventID);
+        analysisManager->FillNtupleIColumn(fEdepNtupleId, 1, row.cellID);
+        analysisManager->FillNtupleDColumn(fEdepNtupleId, 2, row.edep / MeV);
+        analysisManager->FillNtupleIColumn(fEdepNtupleId, 3, row.primaryID);
+        analysisManager->AddNtupleRow(fEdepNtupleId);
+    }
+
+    for (const auto& row : record.spectrum) {
+        analysisManager->FillNtupleIColumn(fSpectrumNtupleId, 0, record.eventID);
+        analysisManager->FillNtupleIColumn(fSpectrumNtupleId, 1, row.cellID);
+        analysisManager->FillNtupleSColumn(fSpectrumNtupleId, 2, row.particle->GetParticleName());
+        analysisManager->FillNtupleDColumn(fSpectrumNtupleId, 3, row.energy / MeV);
+        analysisManager->FillNtupleIColumn(fSpectrumNtupleId, 4, row.primaryID);
+        analysisManager->AddNtupleRow(fSpectrumNtupleId);
+    }
+
+    for (const auto& row : record.muonSteps) {
+        analysisManager->FillNtupleIColumn(fMuonTrackNtupleId, 0, record.eventID);
+        analysisManager->FillNtupleDColumn(fMuonTrackNtupleId, 1, row.prePosition.x() / cm);
+        analysisManager->FillNtupleDColumn(fMuonTrackNtupleId, 2, row.prePosition.y() / cm);
+        analysisManager->FillNtupleDColumn(fMuonTrackNtupleId, 3, row.prePosition.z() / cm);
+        analysisManager->FillNtupleDColumn(fMuonTrackNtupleId, 4, row.postPosition.x() / cm);
+        analysisManager->FillNtupleDColumn(fMuonTrackNtupleId, 5, row.postPosition.y() / cm);
+        analysisManager->FillNtupleDColumn(fMuonTrackNtupleId, 6, row.postPosition.z() / cm);
+        analysisManager->FillNtupleIColumn(fMuonTrackNtupleId, 7, row.primaryID);
+        analysisManager->AddNtupleRow(fMuonTrackNtupleId);
+    }
+
+    if (fEventIndexNtupleId >= 0) {
+        analysisManager->FillNtupleIColumn(fEventIndexNtupleId, 0, record.eventID);
+        analysisManager->FillNtupleDColumn(fEventIndexNtupleId, 1, fEdepEntries);
+        analysisManager->FillNtupleIColumn(fEventIndexNtupleId, 2, record.edep.size());
+        analysisManager->FillNtupleDColumn(fEventIndexNtupleId, 3, fSpectrumEntries);
+        analysisManager->FillNtupleIColumn(fEventIndexNtupleId, 4, record.spectrum.size());
+        analysisManager->FillNtupleDColumn(fEventIndexNtupleId, 5, fMuonTrackEntries);
+        analysisManager->FillNtupleIColumn(fEventIndexNtupleId, 6, record.muonSteps.size());
+        analysisManager->AddNtupleRow(fEventIndexNtupleId);
+
+        fEdepEntries += record.edep.size();
+        fSpectrumEntries += record.spectrum.size();
+        fMuonTrackEntries += record.muonSteps.size();
+    }
+
+    LiveMonitor& liveMonitor = LiveMonitor::Instance();
+    if (liveMonitor.IsPublishing()) {
+        liveMonitor.AddOutputBytes(record.GetEdepBytes() + record.GetSpectrumBytes() + record.GetMuonStepBytes(),
+                                   G4Threading::G4GetThreadId());
+    }
+}
+
+void RunAction::FlushIfDue(G4int eventID)
+{
+    G4RootAnalysisManager* analysisManager = fAnalysisManager;
+
+    // CRITICAL: Manually write ROOT data every 50 events to prevent memory overflow
+    // This is essential to prevent corruption around event 775
+
+    // Write more frequently than every 100 events to be safe
+    if (eventID > 0 && eventID % 50 == 0) {
+        // Force write to disk
+        analysisManager->Write();
+        fMemoryMonitor->NotifyFlush();
+
+        G4cout << "RunAction: Forced write to ROOT file at event " << eventID
+               << " to prevent memory overflow." << G4endl;
+    }
+
+    // Additional safety check - if we're approaching the problematic event range
+    if (eventID > 700 && eventID < 850) {
+        // Write even more frequently in the danger zone
+        if (eventID % 10 == 0) {
+            analysisManager->Write();
+            fMemoryMonitor->NotifyFlush();
+            G4cout << "RunAction: Extra safety write at event " << eventID << G4endl;
+        }
     }
-    G4cout << "RunAction (Thread " << G4Threading::G4GetThreadId()
-           << "): Called OpenFile. Effective filename for manager: "
-           << analysisManager->GetFileName() << ".root" << G4endl;
 }
 
 void RunAction::EndOfRunAction(const G4Run* run)
@@ -110,6 +460,21 @@ void RunAction::EndOfRunAction(const G4Run* run)
     G4int nofEvents = run->GetNumberOfEvent();
     G4RootAnalysisManager* analysisManager = G4RootAnalysisManager::Instance();
 
+    // Let the writer finish this thread's events and close its file
+    if (fOutputQueue) {
+        fOutputQueue->Finish();
+        OutputWriter::Instance().Unregister(fOutputQueue.get());
+        G4cout << "RunAction (Thread " << G4Threading::G4GetThreadId()
+               << "): writer queue peak depth " << fOutputQueue->GetMaxDepth()
+               << " events, " << fOutputQueue->GetStalls() << " waits on a full queue." << G4endl;
+        G4String errors = fOutputQueue->GetErrors();
+        if (!errors.empty()) {
+            G4Exception("RunAction::EndOfRunAction", "WriterOutputError", JustWarning,
+                        ("Writer thread output " + GetWriterFileName() + ": " + errors).c_str());
+        }
+        fOutputQueue.reset();
+    }
+
     // Merge and print accumulables (only from master thread for global summary)
     if (G4Threading::IsMasterThread()) {
         if (nofEvents > 0) {
@@ -125,14 +490,37 @@ void RunAction::EndOfRunAction(const G4Run* run)
                    << " The run consists of " << nofEvents << " events." << G4endl
                    << " Cumulative Edep (summed): " << G4BestUnit(edep,"Energy")
                    << " +- " << G4BestUnit(rms,"Energy")
-                   << G4endl
-                   << "---------------------------------------------------------------------------" << G4endl;
+                   << G4endl;
+
+            G4int accepted = fTriggerAccepted.GetValue();
+            G4int rejected = fTriggerRejected.GetValue();
+            if (accepted + rejected > 0) {
+                // Estimate: every rejected event would have cost the mean post-trigger
+                // CPU time of the accepted ones
+                G4double meanCpu = accepted > 0 ? fTriggerAcceptedCpu.GetValue() / accepted : 0.;
+                G4cout << " Software trigger: " << accepted << " accepted, " << rejected << " rejected"
+                       << " (trigger rate " << 100. * accepted / (accepted + rejected) << " %)" << G4endl
+                       << " CPU time saved by early abort (estimate): " << rejected * meanCpu << " s"
+                       << " (" << meanCpu << " s per accepted event after the decision)" << G4endl;
+            }
+
+            G4cout << "---------------------------------------------------------------------------" << G4endl;
         } else {
             G4cout << "RunAction (Master): EndOfRunAction, no events processed." << G4endl;
         }
     }
 
+    fMemoryMonitor->NotifyFlush();
+    fMemoryMonitor->EndOfRun();
+    if (G4Threading::IsMasterThread()) {
+        LiveMonitor::Instance().EndOfRun();
+        InferenceStream::Instance().EndOfRun();
+    }
+
+    if (!UsesAnalysisFile()) return;
+
     // Write any remaining data and close ROOT file
+    // (in histogram mode the worker histograms are merged into the master here)
     analysisManager->Write();
     analysisManager->CloseFile();
 
@@ -140,6 +528,16 @@ void RunAction::EndOfRunAction(const G4Run* run)
            << "): ROOT data written and file closed." << G4endl;
 }
 
+void RunAction::AddTriggerDecision(G4bool accepted, G4double cpuAfterDecision)
+{
+    if (accepted) {
+        fTriggerAccepted += 1;
+        fTriggerAcceptedCpu += cpuAfterDecision;
+    } else {
+        fTriggerRejected += 1;
+    }
+}
+
 void RunAction::AddEdep(G4double edep)
 {
     fEdep  += edep;
@@ -6,8 +6,14 @@
 #include "G4Accumulable.hh"
 #include "globals.hh"
 
+#include <memory>
+
 class G4Run;
 class G4RootAnalysisManager;
+class G4GenericMessenger;
+class MemoryMonitor;
+class OutputQueue;
+struct EventRecord;
 
 class RunAction : public G4UserRunAction
 {
@@ -20,21 +26,94 @@ public:
 
     void AddEdep(G4double edep); // For overall Edep summary if still used
 
+    // Software trigger bookkeeping; for accepted events, the CPU time spent
+    // after the trigger decision (what rejecting the event would have saved)
+    void AddTriggerDecision(G4bool accepted, G4double cpuAfterDecision);
+
+    // Calibration runs book per-cell/per-plane histograms instead of the ntuples
+    G4bool IsHistogramMode() const { return fHistogramMode; }
+
+    // False when events only go to the shared-memory stream: no file is opened
+    G4bool IsFileOutput() const { return fFileOutput; }
+
+    MemoryMonitor* GetMemoryMonitor() const { return fMemoryMonitor; }
+
+    // Hand-off to the writer thread; nullptr when the ntuples are filled in place
+    OutputQueue* GetOutputQueue() const { return fOutputQueue.get(); }
+
+    // Fill the analysis manager's ntuples from one event, and write them out
+    // periodically (simulation thread, without the async writer)
+    void WriteEventRecord(const EventRecord& record);
+    void FlushIfDue(G4int eventID);
+
     G4int GetSpectrumNtupleId() const { return fSpectrumNtupleId; }
     G4int GetEdepNtupleId() const { return fEdepNtupleId; }
     G4int GetMuonTrackNtupleId() const { return fMuonTrackNtupleId; }
+    G4int GetEventIndexNtupleId() const { return fEventIndexNtupleId; }
+
+    // Histogram IDs are booked consecutively: first ID + cell (or plane) index
+    G4int GetCellLightH1Id(G4int cellID) const { return fCellLightH1Id + cellID; }
+    G4int GetCellEdepH1Id(G4int cellID) const { return fCellEdepH1Id + cellID; }
+    G4int GetPlaneMultiplicityH1Id(G4int plane) const { return fPlaneMultiplicityH1Id + plane; }
+    G4int GetPlaneLightMapH2Id(G4int plane) const { return fPlaneLightMapH2Id + plane; }
 
 private:
+    void DefineCommands();
+    void BookNtuples();
+    void BookHistograms();
+
+    // False when the async writer writes the trees to its own files instead
+    G4bool UsesAnalysisFile() const { return fFileOutput && (fHistogramMode || !fAsyncWriter); }
+    G4String GetWriterFileName() const;
+
     // For overall Edep summary (optional)
     G4Accumulable<G4double> fEdep;
     G4Accumulable<G4double> fEdep2;
 
+    // Software trigger counters
+    G4Accumulable<G4int>    fTriggerAccepted;
+    G4Accumulable<G4int>    fTriggerRejected;
+    G4Accumulable<G4double> fTriggerAcceptedCpu;
+
+    // Output mode, fixed once the first run has booked its objects
+    G4bool fHistogramMode;
+    G4bool fEventIndex;
+    G4bool fFileOutput;
+    G4bool fBooked;
+    G4bool fBookedEventIndex;
+    G4bool fBookedAsyncWriter;
+
+    // Rows this thread has filled into each ntuple since the file was opened,
+    // i.e. the entry number of the next row (event index only)
+    G4double fEdepEntries;
+    G4double fSpectrumEntries;
+    G4double fMuonTrackEntries;
+
+    // Asynchronous output: ntuple filling and file I/O on the writer thread
+    G4bool fAsyncWriter;
+    G4int  fQueueCapacity;
+    std::shared_ptr<OutputQueue> fOutputQueue; // shared with the writer thread's current pass
+
+    // Per-event seeding (0 = derive the run seed from the engine state, i.e. /random/setSeeds)
+    G4long fRunSeed; // 64-bit, like EventSeeder's run seed
+    G4bool fPerEventSeeding;
+
     // Ntuple IDs - properly initialized in constructor
     G4int fSpectrumNtupleId;
     G4int fEdepNtupleId;
     G4int fMuonTrackNtupleId;
+    G4int fEventIndexNtupleId;
+
+    // First IDs of the histogram blocks (histogram mode only)
+    G4int fCellLightH1Id;
+    G4int fCellEdepH1Id;
+    G4int fPlaneMultiplicityH1Id;
+    G4int fPlaneLightMapH2Id;
 
     G4RootAnalysisManager* fAnalysisManager;
+    MemoryMonitor* fMemoryMonitor;
+    G4GenericMessenger* fMessenger;
+    G4GenericMessenger* fRandomMessenger;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,139 @@
+﻿#include "ShowerLibrary.hh"
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    struct Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t particleSize;
+        std::uint64_t nEvents;
+        std::uint64_t nParticles;
+        std::uint64_t particleOffset;
+        std::uint64_t eventTableOffset;
+        char padding[16];
+    };
+    static_assert(sizeof(Header) == 64, "ShowerLibrary header must be 64 bytes");
+    static_assert(sizeof(ShowerLibrary::Particle) == 32, "ShowerLibrary particle must be 32 bytes");
+
+    const char kMagic[8] = {'C', 'M', 'T', 'S', 'H', 'L', 'B', '1'};
+
+    void Fail(const G4String& fileName, const G4String& reason)
+    {
+        G4Exception("ShowerLibrary::ShowerLibrary()", "ShowerLibraryError",
+                    FatalException, ("Cannot use shower library " + fileName + ": " + reason).c_str());
+    }
+}
+
+std::shared_ptr<const ShowerLibrary> ShowerLibrary::Open(const G4String& fileName)
+{
+    static std::mutex mutex;
+    static std::map<G4String, std::weak_ptr<const ShowerLibrary>> openLibraries;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const ShowerLibrary> library = openLibraries[fileName].lock();
+    if (!library) {
+        library.reset(new ShowerLibrary(fileName));
+        openLibraries[fileName] = library;
+    }
+    return library;
+}
+
+ShowerLibrary::ShowerLibrary(const G4String& fileName)
+ : fFileName(fileName),
+   fMapping(nullptr),
+   fMappingSize(0),
+   fNofEvents(0),
+   fParticles(nullptr),
+   fEventTable(nullptr)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        Fail(fileName, std::strerror(errno));
+        return;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(Header)) {
+        close(fd);
+        Fail(fileName, "file too small for a header");
+        return;
+    }
+    fMappingSize = status.st_size;
+
+    // The mapping stays valid after the descriptor is closed
+    fMapping = mmap(nullptr, fMappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (fMapping == MAP_FAILED) {
+        fMapping = nullptr;
+        Fail(fileName, std::strerror(errno));
+        return;
+    }
+
+    const Header* header = static_cast<const Header*>(fMapping);
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != 1) {
+        Fail(fileName, "not a version 1 shower library");
+        return;
+    }
+    if (header->particleSize != sizeof(Particle)) {
+        Fail(fileName, "unexpected particle record size");
+        return;
+    }
+
+    // Counts beyond the file size would overflow the byte sizes below
+    if (header->nParticles > fMappingSize / sizeof(Particle) ||
+        header->nEvents >= fMappingSize / sizeof(std::uint64_t)) {
+        Fail(fileName, "truncated or inconsistent file");
+        return;
+    }
+    std::uint64_t particleBytes = header->nParticles * sizeof(Particle);
+    std::uint64_t tableBytes = (header->nEvents + 1) * sizeof(std::uint64_t);
+    if (header->particleOffset % alignof(Particle) != 0 ||
+        header->eventTableOffset % alignof(std::uint64_t) != 0 ||
+        header->particleOffset + particleBytes > fMappingSize ||
+        header->eventTableOffset + tableBytes > fMappingSize) {
+        Fail(fileName, "truncated or inconsistent file");
+        return;
+    }
+
+    const char* base = static_cast<const char*>(fMapping);
+    fNofEvents = header->nEvents;
+    fParticles = reinterpret_cast<const Particle*>(base + header->particleOffset);
+    fEventTable = reinterpret_cast<const std::uint64_t*>(base + header->eventTableOffset);
+
+    // GetParticles() trusts the table: it must be non-decreasing and end at the
+    // particle count, so every event lies inside the particle block
+    if (fEventTable[fNofEvents] != header->nParticles) {
+        Fail(fileName, "event table does not match the particle count");
+        return;
+    }
+    for (std::size_t event = 0; event < fNofEvents; ++event) {
+        if (fEventTable[event] > fEventTable[event + 1]) {
+            Fail(fileName, "event table offsets decrease at event " + std::to_string(event));
+            return;
+        }
+    }
+
+    G4cout << "ShowerLibrary: mapped " << fileName << " with " << fNofEvents << " events, "
+           << header->nParticles << " particles." << G4endl;
+}
+
+ShowerLibrary::~ShowerLibrary()
+{
+    if (fMapping) munmap(fMapping, fMappingSize);
+}
+
+void ShowerLibrary::AdviseAccess(G4bool sequential) const
+{
+    if (fMapping) madvise(fMapping, fMappingSize, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+}
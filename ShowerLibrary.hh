@@ -0,0 +1,75 @@
+﻿#ifndef ShowerLibrary_h
+#define ShowerLibrary_h 1
+
+#include "globals.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Read-only, memory-mapped library of precomputed multi-particle events
+// (e.g. from an external cosmic shower generator). Events are accessed in place,
+// without copying, so libraries much larger than memory can be streamed; one
+// mapping is shared by all threads.
+//
+// File layout (little endian), written by make_shower_library.py:
+//   Header, 64 bytes:
+//     char     magic[8]          "CMTSHLB1"
+//     uint32   version           1
+//     uint32   particleSize      sizeof(Particle) = 32
+//     uint64   nEvents
+//     uint64   nParticles
+//     uint64   particleOffset    byte offset of the particle array
+//     uint64   eventTableOffset  byte offset of the event table
+//     (zero padding up to 64 bytes)
+//   Particle array: nParticles x Particle, grouped by event
+//   Event table:    (nEvents + 1) x uint64, index of the first particle of each
+//                   event; the last entry is nParticles
+class ShowerLibrary
+{
+public:
+    struct Particle
+    {
+        std::int32_t pdgCode;
+        float x, y, z;    // mm
+        float px, py, pz; // MeV
+        float t;          // ns
+    };
+
+    // Maps the file, or returns the mapping already open for this path
+    static std::shared_ptr<const ShowerLibrary> Open(const G4String& fileName);
+
+    ~ShowerLibrary();
+    ShowerLibrary(const ShowerLibrary&) = delete;
+    ShowerLibrary& operator=(const ShowerLibrary&) = delete;
+
+    const G4String& GetFileName() const { return fFileName; }
+    std::uint64_t GetNumberOfEvents() const { return fNofEvents; }
+
+    std::uint64_t GetNumberOfParticles(std::uint64_t event) const
+    {
+        return fEventTable[event + 1] - fEventTable[event];
+    }
+
+    // Pointer into the mapping; valid while the library is alive
+    const Particle* GetParticles(std::uint64_t event) const
+    {
+        return fParticles + fEventTable[event];
+    }
+
+    // Page-cache hint matching the replay access pattern
+    void AdviseAccess(G4bool sequential) const;
+
+private:
+    explicit ShowerLibrary(const G4String& fileName);
+
+    G4String fFileName;
+    void* fMapping;
+    std::size_t fMappingSize;
+
+    std::uint64_t fNofEvents;
+    const Particle* fParticles;
+    const std::uint64_t* fEventTable;
+};
+
+#endif
@@ -0,0 +1,93 @@
+﻿#include "StackingAction.hh"
+#include "EventAction.hh"
+
+#include "G4Track.hh"
+#include "G4StackManager.hh"
+#include "G4RunManager.hh"
+#include "G4GenericMessenger.hh"
+#include "G4OpticalPhoton.hh"
+#include "G4Version.hh"
+
+namespace
+{
+    // Optical photon sub-event type (fSubEvent_0)
+    const G4int kPhotonSubEventType = 0;
+}
+
+StackingAction::StackingAction(EventAction* eventAction)
+ : G4UserStackingAction(),
+   fEventAction(eventAction),
+   fStage(0),
+   fSubEventMaster(false),
+   fSubEventWorker(false),
+   fPhotonsPerTask(0),
+   fMessenger(nullptr)
+{
+#if G4VERSION_NUMBER >= 1120
+    fSubEventMaster = G4RunManager::GetRunManager()->GetRunManagerType() == G4RunManager::subEventMasterRM;
+    fSubEventWorker = G4RunManager::GetRunManager()->GetRunManagerType() == G4RunManager::subEventWorkerRM;
+#endif
+
+    fMessenger = new G4GenericMessenger(this, "/tomography/subevent/", "Sub-event parallel photon tracking");
+
+    auto& photonsCmd = fMessenger->DeclareMethod("photonsPerTask", &StackingAction::SetPhotonsPerTask,
+        "Optical photons per sub-event task in sub-event parallel mode (0 = track them with their event).");
+    photonsCmd.SetParameterName("N", false);
+    photonsCmd.SetRange("N>=0");
+    photonsCmd.AvailableForStates(G4State_PreInit, G4State_Idle);
+
+    if (fSubEventMaster) SetPhotonsPerTask(1000);
+}
+
+StackingAction::~StackingAction()
+{
+    delete fMessenger;
+}
+
+void StackingAction::SetPhotonsPerTask(G4int photonsPerTask)
+{
+    if (!fSubEventMaster) return;
+
+#if G4VERSION_NUMBER >= 1120
+    if (photonsPerTask > 0) {
+        G4RunManager::GetRunManager()->RegisterSubEventType(kPhotonSubEventType, photonsPerTask);
+    }
+#endif
+    fPhotonsPerTask = photonsPerTask;
+}
+
+G4ClassificationOfNewTrack StackingAction::ClassifyNewTrack(const G4Track* track)
+{
+    // Sub-event tracks are secondaries of an event the master has already triggered on;
+    // this thread has none of the event's energy deposits to decide again
+    if (fSubEventWorker) return fUrgent;
+
+    if (fStage == 0 && track->GetParentID() > 0 && fEventAction->IsTriggerEnabled()) {
+        return fWaiting;
+    }
+
+#if G4VERSION_NUMBER >= 1120
+    // Photons of accepted events (or all events without trigger) go to the workers
+    if (fPhotonsPerTask > 0 && track->GetDefinition() == G4OpticalPhoton::Definition()) {
+        return static_cast<G4ClassificationOfNewTrack>(fSubEvent_0 + kPhotonSubEventType);
+    }
+#endif
+    return fUrgent;
+}
+
+void StackingAction::NewStage()
+{
+    // Urgent stack empty for the first time: the primaries are done
+    if (fStage++ != 0 || fSubEventWorker) return;
+
+    if (fEventAction->EvaluateTrigger()) {
+        stackManager->ReClassify();
+    } else {
+        stackManager->clear();
+    }
+}
+
+void StackingAction::PrepareNewEvent()
+{
+    fStage = 0;
+}
@@ -0,0 +1,43 @@
+﻿#ifndef StackingAction_h
+#define StackingAction_h 1
+
+#include "G4UserStackingAction.hh"
+#include "globals.hh"
+
+class EventAction;
+
+class G4GenericMessenger;
+
+// Two-stage stacking for the software trigger: while the trigger is enabled,
+// secondaries wait until the primaries are fully tracked. The trigger is then
+// evaluated once; a rejected event has its remaining stack cleared, so none of
+// its optical photons or other secondaries are tracked.
+//
+// In sub-event parallel mode (Geant4 >= 11.2, G4RUN_MANAGER_TYPE=SubEvt) optical
+// photons are sent to the sub-event stack instead, which hands them to worker
+// threads in chunks of /tomography/subevent/photonsPerTask tracks.
+class StackingAction : public G4UserStackingAction
+{
+public:
+    StackingAction(EventAction* eventAction);
+    virtual ~StackingAction();
+
+    virtual G4ClassificationOfNewTrack ClassifyNewTrack(const G4Track* track) override;
+    virtual void NewStage() override;
+    virtual void PrepareNewEvent() override;
+
+    // Registers the optical photon sub-event type with the master run manager
+    void SetPhotonsPerTask(G4int photonsPerTask);
+
+private:
+    EventAction* fEventAction;
+    G4int fStage;
+
+    G4bool fSubEventMaster;  // this thread runs the event loop of a sub-event parallel run
+    G4bool fSubEventWorker;  // this thread tracks photon sub-events the master already accepted
+    G4int  fPhotonsPerTask;  // 0 = track the photons with their event
+
+    G4GenericMessenger* fMessenger;
+};
+
+#endif
@@ -1,5 +1,6 @@
 ﻿#include "SteppingAction.hh"
 #include "EventAction.hh"
+#include "EventRecord.hh"
 #include "DetectorConstruction.hh"
 #include "RunAction.hh"
 
@@ -10,18 +11,15 @@
 #include "G4VPhysicalVolume.hh"
 #include "G4Track.hh"
 #include "G4ParticleDefinition.hh"
+#include "G4OpticalPhoton.hh"
+#include "G4MuonMinus.hh"
 #include "G4SystemOfUnits.hh"
 
-// Changed from CSV to ROOT
-#include "G4RootAnalysisManager.hh"
-
 SteppingAction::SteppingAction(EventAction* eventAction)
  : G4UserSteppingAction(),
    fEventAction(eventAction),
    fScoringVolume(nullptr),
-   fSpectrumNtupleId(-1),
-   fEdepNtupleId(-1),
-   fMuonTrackNtupleId(-1)
+   fFillNtuples(true)
 {
     if (!fEventAction) {
         G4Exception("SteppingAction::SteppingAction()", "NoEventAction",
@@ -31,9 +29,6 @@ SteppingAction::SteppingAction(EventAction* eventAction)
 
 void SteppingAction::UserSteppingAction(const G4Step* step)
 {
-    // Changed from CSV to ROOT
-    G4RootAnalysisManager* analysisManager = G4RootAnalysisManager::Instance();
-
     if (!fScoringVolume) {
         const DetectorConstruction* detectorConstruction =
             static_cast<const DetectorConstruction*>(
@@ -49,77 +44,68 @@ void SteppingAction::UserSteppingAction(const G4Step* step)
 
         const RunAction* runAction = static_cast<const RunAction*>(fEventAction->GetRunAction());
         if (runAction) {
-            fSpectrumNtupleId = runAction->GetSpectrumNtupleId();
-            fEdepNtupleId = runAction->GetEdepNtupleId();
-            fMuonTrackNtupleId = runAction->GetMuonTrackNtupleId();
+            fFillNtuples = !runAction->IsHistogramMode();
         } else {
             G4Exception("SteppingAction::UserSteppingAction()", "NoRunActionFromEvent",
-                        FatalException, "Could not get RunAction from EventAction to retrieve NTuple IDs.");
+                        FatalException, "Could not get RunAction from EventAction to retrieve the output mode.");
             return;
         }
 
-        if (fSpectrumNtupleId < 0 || fEdepNtupleId < 0 || fMuonTrackNtupleId < 0) {
-            G4String errMsg = "One or more NTuple IDs were not properly set from RunAction. IDs are: Spectrum=" +
-                              std::to_string(fSpectrumNtupleId) + ", Edep=" + std::to_string(fEdepNtupleId) +
-                              ", MuonTrack=" + std::to_string(fMuonTrackNtupleId);
-            G4Exception("SteppingAction::UserSteppingAction()", "InvalidNtupleIDs",
-                        FatalException, errMsg);
-            return;
-        }
-        G4cout << "SteppingAction: NTuple IDs initialized. SpectrumID: " << fSpectrumNtupleId
-               << ", EdepID: " << fEdepNtupleId << ", MuonTrackID: " << fMuonTrackNtupleId << G4endl;
+        G4cout << "SteppingAction: " << (fFillNtuples ? "ntuple rows buffered per event."
+                                                      : "Histogram mode, ntuple filling disabled.") << G4endl;
     }
 
-    G4int eventID = G4RunManager::GetRunManager()->GetCurrentEvent()->GetEventID();
+    fEventAction->CountStep();
+
+    // Rows are buffered per event and filled into the ntuples at end of event
+    EventRecord* record = fFillNtuples ? fEventAction->GetRecord() : nullptr;
+
     G4StepPoint* preStepPoint = step->GetPreStepPoint();
     G4VPhysicalVolume* preStepPhysicalVolume = preStepPoint->GetTouchableHandle()->GetVolume();
     if (!preStepPhysicalVolume) return;
     G4LogicalVolume* preStepLogicalVolume = preStepPhysicalVolume->GetLogicalVolume();
 
+    G4int primaryID = fEventAction->GetPrimaryID();
+
     if (preStepLogicalVolume == fScoringVolume) {
         G4int cellID = preStepPoint->GetTouchableHandle()->GetCopyNumber(0);
         G4double edepStep = step->GetTotalEnergyDeposit();
         if (edepStep > 0.) {
-            analysisManager->FillNtupleIColumn(fEdepNtupleId, 0, eventID);
-            analysisManager->FillNtupleIColumn(fEdepNtupleId, 1, cellID);
-            analysisManager->FillNtupleDColumn(fEdepNtupleId, 2, edepStep / MeV);
-            analysisManager->AddNtupleRow(fEdepNtupleId);
+            if (record) {
+                record->edep.push_back({cellID, edepStep, primaryID});
+            }
 
             if (fEventAction) {
                  fEventAction->AddEdep(edepStep);
+                 fEventAction->AddCellEdep(cellID, edepStep);
             }
         }
 
         G4StepPoint* postStepPoint = step->GetPostStepPoint();
         if (postStepPoint->GetStepStatus() == fGeomBoundary) {
             G4Track* track = step->GetTrack();
-            G4ParticleDefinition* particleDef = track->GetDefinition();
-            G4String particleName = particleDef->GetParticleName();
+            const G4ParticleDefinition* particleDef = track->GetDefinition();
             G4double energy = track->GetKineticEnergy();
-            if (particleName == "opticalphoton") {
+            if (particleDef == G4OpticalPhoton::Definition()) {
                 energy = track->GetTotalEnergy();
+                fEventAction->AddCellPhoton(cellID, energy);
+            }
+            if (record) {
+                record->spectrum.push_back({cellID, particleDef, energy, primaryID});
             }
-            analysisManager->FillNtupleIColumn(fSpectrumNtupleId, 0, eventID);
-            analysisManager->FillNtupleIColumn(fSpectrumNtupleId, 1, cellID);
-            analysisManager->FillNtupleSColumn(fSpectrumNtupleId, 2, particleName);
-            analysisManager->FillNtupleDColumn(fSpectrumNtupleId, 3, energy / MeV);
-            analysisManager->AddNtupleRow(fSpectrumNtupleId);
         }
     }
 
     G4Track* currentTrack = step->GetTrack();
-    if (currentTrack->GetTrackID() == 1 && currentTrack->GetDefinition()->GetParticleName() == "mu-") {
-        G4StepPoint* postStepPoint = step->GetPostStepPoint();
-        G4ThreeVector prePos = preStepPoint->GetPosition();
-        G4ThreeVector postPos = postStepPoint->GetPosition();
-
-        analysisManager->FillNtupleIColumn(fMuonTrackNtupleId, 0, eventID);
-        analysisManager->FillNtupleDColumn(fMuonTrackNtupleId, 1, prePos.x() / cm);
-        analysisManager->FillNtupleDColumn(fMuonTrackNtupleId, 2, prePos.y() / cm);
-        analysisManager->FillNtupleDColumn(fMuonTrackNtupleId, 3, prePos.z() / cm);
-        analysisManager->FillNtupleDColumn(fMuonTrackNtupleId, 4, postPos.x() / cm);
-        analysisManager->FillNtupleDColumn(fMuonTrackNtupleId, 5, postPos.y() / cm);
-        analysisManager->FillNtupleDColumn(fMuonTrackNtupleId, 6, postPos.z() / cm);
-        analysisManager->AddNtupleRow(fMuonTrackNtupleId);
+    if (currentTrack->GetParentID() == 0 && currentTrack->GetDefinition() == G4MuonMinus::Definition()) {
+        // The truth position follows the first primary; with pile-up, every primary
+        // muon's steps are written, tagged with its PrimaryID
+        if (currentTrack->GetTrackID() == 1) {
+            fEventAction->AddMuonStep(preStepPoint->GetPosition());
+        }
+        if (record) {
+            G4StepPoint* postStepPoint = step->GetPostStepPoint();
+            record->muonSteps.push_back({preStepPoint->GetPosition(), postStepPoint->GetPosition(), primaryID});
+        }
     }
-}
\ No newline at end of file
+}
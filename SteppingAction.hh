@@ -19,9 +19,7 @@ public:
 private:
     EventAction* fEventAction;
     const G4LogicalVolume* fScoringVolume;
-    G4int fSpectrumNtupleId;
-    G4int fEdepNtupleId;
-    G4int fMuonTrackNtupleId;
+    G4bool fFillNtuples;
     
 };
 
@@ -0,0 +1,49 @@
+﻿#ifndef SubEventResult_h
+#define SubEventResult_h 1
+
+#include "G4VUserEventInformation.hh"
+#include "DetectorConstruction.hh"
+#include "EventRecord.hh"
+#include "globals.hh"
+
+#include <array>
+
+// What a sub-event (a chunk of one event's optical photons, tracked by a worker
+// in sub-event parallel mode) contributed: per-cell sums and ntuple rows. The
+// worker attaches it to the sub-event; EventAction::MergeSubEvent accumulates
+// it on the parent event, whose EndOfEventAction adds it to the event output.
+class SubEventResult : public G4VUserEventInformation
+{
+public:
+    SubEventResult()
+    {
+        cellEdep.fill(0.);
+        cellPhotons.fill(0);
+        cellLight.fill(0.);
+    }
+
+    void Merge(const SubEventResult& other)
+    {
+        edep += other.edep;
+        for (G4int cellID = 0; cellID < DetectorConstruction::kNofCells; ++cellID) {
+            cellEdep[cellID] += other.cellEdep[cellID];
+            cellPhotons[cellID] += other.cellPhotons[cellID];
+            cellLight[cellID] += other.cellLight[cellID];
+        }
+        rows.Append(other.rows);
+    }
+
+    virtual void Print() const override
+    {
+        G4cout << "SubEventResult: " << rows.spectrum.size() << " spectrum rows, "
+               << rows.edep.size() << " energy deposit rows" << G4endl;
+    }
+
+    G4double edep = 0.;
+    std::array<G4double, DetectorConstruction::kNofCells> cellEdep;
+    std::array<G4int, DetectorConstruction::kNofCells>    cellPhotons;
+    std::array<G4double, DetectorConstruction::kNofCells> cellLight;
+    EventRecord rows;
+};
+
+#endif
@@ -0,0 +1,19 @@
+﻿#include "TrackingAction.hh"
+#include "EventAction.hh"
+
+#include "G4Track.hh"
+
+TrackingAction::TrackingAction(EventAction* eventAction)
+ : G4UserTrackingAction(),
+   fEventAction(eventAction)
+{
+    if (!fEventAction) {
+        G4Exception("TrackingAction::TrackingAction()", "NoEventAction",
+                    FatalException, "EventAction pointer is null in constructor.");
+    }
+}
+
+void TrackingAction::PreUserTrackingAction(const G4Track* track)
+{
+    fEventAction->BeginTrack(track->GetTrackID(), track->GetParentID());
+}
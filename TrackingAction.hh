@@ -0,0 +1,24 @@
+﻿#ifndef TrackingAction_h
+#define TrackingAction_h 1
+
+#include "G4UserTrackingAction.hh"
+#include "globals.hh"
+
+class EventAction;
+
+// Tags each track with the primary it descends from, so that hits of pile-up
+// events (several muons in one readout window) can be told apart. EventAction
+// keeps the lookup only for events with more than one primary.
+class TrackingAction : public G4UserTrackingAction
+{
+public:
+    TrackingAction(EventAction* eventAction);
+    virtual ~TrackingAction() = default;
+
+    virtual void PreUserTrackingAction(const G4Track* track) override;
+
+private:
+    EventAction* fEventAction;
+};
+
+#endif
@@ -0,0 +1,179 @@
+import argparse
+import glob
+import os
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+
+# G4UIbatch stops at the first failing command but the job still exits with 0
+MACRO_ABORTED = re.compile(r'COMMAND NOT FOUND|Batch is interrupted|command refused|Illegal application state')
+
+
+def check_log(log_path, events=None):
+    """Raise if the macro was aborted, or (events given) if the run did not process that many events."""
+    with open(log_path, errors='replace') as log:
+        text = log.read()
+    aborted = MACRO_ABORTED.search(text)
+    if aborted:
+        raise RuntimeError(f"macro aborted ({aborted.group(0)}), see {log_path}")
+    if events is not None and f"The run consists of {events} events." not in text:
+        raise RuntimeError(f"the run did not process {events} events, see {log_path}")
+
+
+def run_macro(executable, macro_text, work_dir, env=None, events=None):
+    """Run one job (with extra environment variables); fail unless it ran the whole macro
+    (and processed the given number of events).
+    Return (wall time in s, peak RSS in MB, bytes of ROOT output)."""
+    macro_path = os.path.join(work_dir, 'benchmark.mac')
+    with open(macro_path, 'w') as macro:
+        macro.write(macro_text)
+
+    with open(os.path.join(work_dir, 'stdout.log'), 'w') as log:
+        start = time.perf_counter()
+        process = subprocess.Popen([os.path.abspath(executable), macro_path], cwd=work_dir,
+                                   env=dict(os.environ, **(env or {})),
+                                   stdout=log, stderr=subprocess.STDOUT)
+        _, status, usage = os.wait4(process.pid, 0)
+        wall = time.perf_counter() - start
+    exit_code = os.waitstatus_to_exitcode(status)
+    if exit_code != 0:
+        raise RuntimeError(f"{executable} exited with {exit_code}, see {work_dir}/stdout.log")
+    check_log(os.path.join(work_dir, 'stdout.log'), events)
+    output_bytes = sum(os.path.getsize(path) for path in glob.glob(os.path.join(work_dir, '*.root')))
+    return wall, usage.ru_maxrss / 1024., output_bytes
+
+
+def repeat(executable, macro_text, repetitions, parent_dir=None, env=None, events=None):
+    walls, rss, output = [], [], []
+    for _ in range(repetitions):
+        with tempfile.TemporaryDirectory(prefix='benchmark_', dir=parent_dir) as work_dir:
+            wall, peak, output_bytes = run_macro(executable, macro_text, work_dir, env, events)
+        walls.append(wall)
+        rss.append(peak)
+        output.append(output_bytes)
+    return statistics.median(walls), statistics.median(rss), statistics.median(output)
+
+
+def startup(args):
+    """Startup cost: kernel initialization only, no events."""
+    macro_text = "/run/numberOfThreads 1\n/run/initialize\n"
+    print(f"{'executable':40s} {'startup [s]':>12s} {'peak RSS [MB]':>14s}")
+    for executable in args.executables:
+        wall, rss, _ = repeat(executable, macro_text, args.repeat)
+        print(f"{executable:40s} {wall:12.2f} {rss:14.1f}")
+
+
+def writer(args):
+    """Event throughput with ntuple I/O on the simulation threads vs. on the writer thread.
+    Point --work-dir at the slow storage under test (network file system, throttled device...)."""
+    baseline, _, _ = repeat(args.executable, f"/run/numberOfThreads {args.threads}\n/run/initialize\n",
+                         args.repeat, args.work_dir)
+    print(f"startup (subtracted): {baseline:.2f} s")
+    print(f"{'asyncWriter':12s} {'wall [s]':>10s} {'events/s':>10s}")
+    for async_writer in ('false', 'true'):
+        macro_text = (f"/run/numberOfThreads {args.threads}\n"
+                      f"/tomography/output/asyncWriter {async_writer}\n"
+                      f"/tomography/output/queueCapacity {args.queue_capacity}\n"
+                      "/run/initialize\n"
+                      "/run/printProgress 0\n"
+                      f"/run/beamOn {args.events}\n")
+        wall, _, _ = repeat(args.executable, macro_text, args.repeat, args.work_dir)
+        print(f"{async_writer:12s} {wall:10.2f} {args.events / max(wall - baseline, 1e-9):10.1f}")
+
+
+def subevent(args):
+    """Few high-multiplicity events: event-level MT leaves threads idle once fewer events than
+    threads remain, sub-event parallel mode spreads each event's optical photons over all threads.
+    photonsPerTask belongs to the worker-thread StackingAction, so it is set after /run/initialize;
+    every leg must report all events, so the speedup reference is a run that did the work."""
+    print(f"{'threads':>8s} {'mode':>8s} {'wall [s]':>10s} {'s/event':>10s} {'speedup':>8s}")
+    reference = None
+    for threads in (int(n) for n in args.threads.split(',')):
+        for mode, env in (('MT', {'G4RUN_MANAGER_TYPE': 'MT'}), ('SubEvt', {'G4RUN_MANAGER_TYPE': 'SubEvt'})):
+            macro_text = (f"/run/numberOfThreads {threads}\n"
+                          "/run/initialize\n"
+                          f"/tomography/subevent/photonsPerTask {args.photons_per_task}\n"
+                          "/run/printProgress 0\n"
+                          f"/run/beamOn {args.events}\n")
+            wall, _, _ = repeat(args.executable, macro_text, args.repeat, env=env, events=args.events)
+            if reference is None:
+                reference = wall
+            print(f"{threads:8d} {mode:>8s} {wall:10.2f} {wall / args.events:10.3f} {reference / wall:8.2f}")
+
+
+def pileup(args):
+    """Throughput stress test: each event is one readout window holding a Poisson number of
+    muons (mean rate x window). Rate 0 is the single-muon reference. The gun and trigger
+    commands belong to worker-thread actions, so they only exist after /run/initialize."""
+    baseline, _, _ = repeat(args.executable, f"/run/numberOfThreads {args.threads}\n/run/initialize\n",
+                            args.repeat, args.work_dir)
+    print(f"startup (subtracted): {baseline:.2f} s")
+    print(f"{'rate [Hz]':>12s} {'muons/event':>12s} {'wall [s]':>10s} {'events/s':>10s} {'muons/s':>10s} "
+          f"{'kB/event':>10s}")
+    for rate in (float(r) for r in args.rates.split(',')):
+        macro_text = (f"/run/numberOfThreads {args.threads}\n"
+                      "/run/initialize\n"
+                      f"/tomography/gun/pileupRate {rate} hertz\n"
+                      f"/tomography/gun/readoutWindow {args.window} ns\n"
+                      f"/tomography/trigger/minPlanes {args.min_planes}\n"
+                      "/run/printProgress 0\n"
+                      f"/run/beamOn {args.events}\n")
+        wall, _, output_bytes = repeat(args.executable, macro_text, args.repeat, args.work_dir,
+                                       events=args.events)
+        multiplicity = rate * args.window * 1e-9 if rate > 0 else 1.
+        events_per_s = args.events / max(wall - baseline, 1e-9)
+        print(f"{rate:12.3g} {multiplicity:12.2f} {wall:10.2f} {events_per_s:10.1f} "
+              f"{events_per_s * multiplicity:10.1f} {output_bytes / args.events / 1024.:10.2f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Performance benchmarks for cosmicMuonTomography.")
+    subparsers = parser.add_subparsers(dest='benchmark', required=True)
+
+    startup_parser = subparsers.add_parser('startup', help="startup time and peak RSS per executable")
+    startup_parser.add_argument('executables', nargs='*',
+                                default=['./cosmicMuonTomography', './cosmicMuonTomography_batch'])
+    startup_parser.add_argument('--repeat', type=int, default=5, help="median over this many runs")
+    startup_parser.set_defaults(function=startup)
+
+    writer_parser = subparsers.add_parser('writer', help="throughput with and without the async writer")
+    writer_parser.add_argument('executable', nargs='?', default='./cosmicMuonTomography_batch')
+    writer_parser.add_argument('--events', type=int, default=2000)
+    writer_parser.add_argument('--threads', type=int, default=os.cpu_count())
+    writer_parser.add_argument('--queue-capacity', type=int, default=256)
+    writer_parser.add_argument('--work-dir', default=None, help="directory on the storage under test")
+    writer_parser.add_argument('--repeat', type=int, default=3)
+    writer_parser.set_defaults(function=writer)
+
+    subevent_parser = subparsers.add_parser('subevent', help="event-level vs sub-event parallel scaling")
+    subevent_parser.add_argument('executable', nargs='?', default='./cosmicMuonTomography_batch')
+    subevent_parser.add_argument('--events', type=int, default=8)
+    subevent_parser.add_argument('--threads', default=f"1,{os.cpu_count()}",
+                                 help="comma separated thread counts; speedup is relative to the first run")
+    subevent_parser.add_argument('--photons-per-task', type=int, default=1000)
+    subevent_parser.add_argument('--repeat', type=int, default=3)
+    subevent_parser.set_defaults(function=subevent)
+
+    pileup_parser = subparsers.add_parser('pileup', help="events/s and bytes/event vs. muon rate")
+    pileup_parser.add_argument('executable', nargs='?', default='./cosmicMuonTomography_batch')
+    pileup_parser.add_argument('--rates', default="0,1e6,5e6,1e7,5e7",
+                               help="comma separated muon rates in Hz; 0 = one muon per event")
+    pileup_parser.add_argument('--window', type=float, default=1000., help="readout window in ns")
+    pileup_parser.add_argument('--events', type=int, default=1000)
+    pileup_parser.add_argument('--threads', type=int, default=os.cpu_count())
+    pileup_parser.add_argument('--min-planes', type=int, default=0, help="software trigger (0 = off)")
+    pileup_parser.add_argument('--work-dir', default=None, help="directory on the storage under test")
+    pileup_parser.add_argument('--repeat', type=int, default=3)
+    pileup_parser.set_defaults(function=pileup)
+
+    args = parser.parse_args()
+    args.function(args)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
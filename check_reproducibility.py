@@ -0,0 +1,117 @@
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+import pandas as pd
+import uproot
+
+TREES = ['EdepData', 'SpectrumData', 'MuonTrackData']
+
+# Two runs in one job: EventIDs restart at 0, the run ID must still give new events
+RUN_FILES = ['tomography_output', 'tomography_output_run1']
+
+MACRO = """/run/numberOfThreads {threads}
+/run/initialize
+/tomography/random/runSeed {seed}
+/run/printProgress 0
+/run/beamOn {events}
+/analysis/setFileName tomography_output_run1
+/run/beamOn {events}
+"""
+
+
+def run_workload(executable, threads, events, seed, work_dir):
+    """Run the same workload with the given number of threads; return the output file of each run."""
+    macro_path = os.path.join(work_dir, 'reproducibility.mac')
+    with open(macro_path, 'w') as macro:
+        macro.write(MACRO.format(threads=threads, seed=seed, events=events))
+
+    with open(os.path.join(work_dir, 'stdout.log'), 'w') as log:
+        subprocess.run([os.path.abspath(executable), macro_path], cwd=work_dir,
+                       stdout=log, stderr=subprocess.STDOUT, check=True)
+    return [os.path.join(work_dir, name + '.root') for name in RUN_FILES]
+
+
+def load_per_event(root_filename):
+    """
+    Per-tree rows ordered by EventID. The sort is stable, so rows of one event
+    keep the order in which the simulating thread filled them, independent of
+    how ntuple merging interleaved the threads.
+    """
+    tables = {}
+    with uproot.open(root_filename) as file:
+        for tree in TREES:
+            df = file[tree].arrays(library="pd")
+            tables[tree] = df.sort_values('EventID', kind='stable').reset_index(drop=True)
+    return tables
+
+
+def compare(reference, candidate):
+    """Return a list of human readable differences (empty when bit-for-bit identical)."""
+    differences = []
+    for tree in TREES:
+        ref, cand = reference[tree], candidate[tree]
+        if ref.equals(cand):
+            continue
+        ref_counts = ref.groupby('EventID').size()
+        cand_counts = cand.groupby('EventID').size()
+        if not ref_counts.equals(cand_counts):
+            counts = pd.concat([ref_counts, cand_counts], axis=1).fillna(-1)
+            changed = counts.index[counts.iloc[:, 0] != counts.iloc[:, 1]]
+            differences.append(f"{tree}: row counts differ for EventIDs {list(changed[:10])}")
+            continue
+        mismatch = (ref != cand).any(axis=1)
+        events = sorted(set(ref.loc[mismatch, 'EventID']))
+        differences.append(f"{tree}: values differ for EventIDs {events[:10]}")
+    return differences
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Check that per-event output does not depend on the number of threads.")
+    parser.add_argument("executable", nargs="?", default="./cosmicMuonTomography")
+    parser.add_argument("--events", type=int, default=200)
+    parser.add_argument("--seed", type=int, default=12345)
+    parser.add_argument("--threads", default=f"1,4,{os.cpu_count()}",
+                        help="comma separated thread counts; the first one is the reference")
+    args = parser.parse_args()
+
+    thread_counts = list(dict.fromkeys(int(n) for n in args.threads.split(',')))
+
+    results = {}
+    with tempfile.TemporaryDirectory(prefix='reproducibility_') as top_dir:
+        for threads in thread_counts:
+            work_dir = os.path.join(top_dir, f'threads_{threads}')
+            os.makedirs(work_dir)
+            print(f"Running {args.events} events with {threads} thread(s)...")
+            results[threads] = [load_per_event(path) for path in
+                                run_workload(args.executable, threads, args.events, args.seed, work_dir)]
+
+    reference_threads = thread_counts[0]
+    failed = False
+    for run, _ in enumerate(RUN_FILES):
+        for threads in thread_counts[1:]:
+            differences = compare(results[reference_threads][run], results[threads][run])
+            if differences:
+                failed = True
+                print(f"FAIL: run {run}, {threads} threads differs from {reference_threads} thread(s):")
+                for difference in differences:
+                    print(f"  {difference}")
+            else:
+                print(f"OK: run {run}, {threads} threads is bit-for-bit identical to {reference_threads} thread(s)")
+
+    # Same seed and EventIDs in both runs: identical content means the run ID is not seeded
+    first_run, second_run = results[reference_threads]
+    if not compare(first_run, second_run):
+        failed = True
+        print("FAIL: the second run replays the events of the first one")
+    else:
+        print("OK: the second run produced different events")
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
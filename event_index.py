@@ -0,0 +1,130 @@
+import argparse
+import glob
+import os
+import sys
+
+import numpy as np
+import pandas as pd
+import uproot
+
+TREES = {'EdepData': 'Edep', 'SpectrumData': 'Spectrum', 'MuonTrackData': 'MuonTrack'}
+
+
+def output_files(path):
+    """The given file, or for a base name like tomography_output.root the per-thread files
+    (tomography_output_t<N>.root) written when the event index disables ntuple merging, or by
+    the async writer."""
+    stem, extension = os.path.splitext(path)
+    files = sorted(glob.glob(f'{stem}_t*{extension or ".root"}'))
+    if os.path.exists(path):
+        files.insert(0, path)
+    if not files:
+        raise FileNotFoundError(path)
+    return files
+
+
+class EventIndex:
+    """
+    EventID -> (file, first entry and row count per tree), read from the EventIndex
+    trees written with /tomography/output/eventIndex true. fetch() then reads only
+    the entries of one event, so it costs the same for any file size.
+
+    Files without an EventIndex tree are indexed by one scan of their EventID
+    branches; that index is exact only where each event's rows are contiguous
+    (sequential runs, or unmerged per-thread files), other events are read by
+    filtering on EventID.
+    """
+
+    def __init__(self, path):
+        self.files = output_files(path)
+        parts = [self._read_index(filename) for filename in self.files]
+        parts = [part for part in parts if len(part)]
+        self.index = pd.concat(parts) if parts else pd.DataFrame()
+        if not self.index.empty and self.index.index.has_duplicates:
+            duplicates = self.index.index[self.index.index.duplicated()].unique()
+            raise ValueError(f"EventIDs present in several files (several runs?): {list(duplicates[:10])}")
+
+    @staticmethod
+    def _read_index(filename):
+        with uproot.open(filename) as file:
+            if 'EventIndex' in file:
+                index = file['EventIndex'].arrays(library='pd')
+                for prefix in TREES.values():
+                    index[f'{prefix}First'] = index[f'{prefix}First'].astype(np.int64)
+                index['Contiguous'] = True
+            else:
+                index = EventIndex._scan(file)
+        index['File'] = filename
+        return index.set_index('EventID')
+
+    @staticmethod
+    def _scan(file):
+        """Fallback: build the index from the EventID branches (one pass per tree)."""
+        columns = []
+        for tree, prefix in TREES.items():
+            if tree not in file:
+                continue
+            event_ids = file[tree]['EventID'].array(library='np')
+            entries = pd.DataFrame({'EventID': event_ids, 'Entry': np.arange(len(event_ids))})
+            grouped = entries.groupby('EventID')['Entry']
+            summary = pd.DataFrame({f'{prefix}First': grouped.min(), f'{prefix}Count': grouped.size(),
+                                    f'{prefix}Last': grouped.max()})
+            columns.append(summary)
+        if not columns:
+            return pd.DataFrame(columns=['EventID'])
+        index = pd.concat(columns, axis=1)
+        contiguous = pd.Series(True, index=index.index)
+        for prefix in TREES.values():
+            if f'{prefix}First' not in index:
+                continue
+            index[[f'{prefix}First', f'{prefix}Count', f'{prefix}Last']] = \
+                index[[f'{prefix}First', f'{prefix}Count', f'{prefix}Last']].fillna(0).astype(np.int64)
+            span = index[f'{prefix}Last'] - index[f'{prefix}First'] + 1
+            contiguous &= (index[f'{prefix}Count'] == 0) | (span == index[f'{prefix}Count'])
+            index = index.drop(columns=f'{prefix}Last')
+        index['Contiguous'] = contiguous
+        return index.reset_index()
+
+    def __len__(self):
+        return len(self.index)
+
+    def __contains__(self, event_id):
+        return event_id in self.index.index
+
+    def event_ids(self):
+        return self.index.index.sort_values()
+
+    def fetch(self, event_id):
+        """All rows of one event: {'EdepData': DataFrame, 'SpectrumData': ..., 'MuonTrackData': ...}."""
+        entry = self.index.loc[event_id]
+        rows = {}
+        with uproot.open(entry['File']) as file:
+            for tree, prefix in TREES.items():
+                if tree not in file or f'{prefix}First' not in entry:
+                    continue
+                if entry['Contiguous']:
+                    first, count = int(entry[f'{prefix}First']), int(entry[f'{prefix}Count'])
+                    rows[tree] = file[tree].arrays(entry_start=first, entry_stop=first + count, library='pd')
+                else:
+                    rows[tree] = file[tree].arrays(cut=f'EventID == {event_id}', library='pd')
+        return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Print all rows of one event from tomography output.")
+    parser.add_argument("event_id", type=int)
+    parser.add_argument("root_file", nargs="?", default="tomography_output.root")
+    args = parser.parse_args()
+
+    index = EventIndex(args.root_file)
+    if args.event_id not in index:
+        print(f"EventID {args.event_id} not found in {', '.join(index.files)}")
+        return 1
+    for tree, rows in index.fetch(args.event_id).items():
+        print(f"--- {tree}: {len(rows)} rows")
+        print(rows.to_string(index=False))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
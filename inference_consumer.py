@@ -0,0 +1,198 @@
+import argparse
+import importlib
+import mmap
+import os
+import sys
+import time
+
+import numpy as np
+
+# Layout written by InferenceStream (see InferenceStream.hh)
+MAGIC = b'CMTSTRM1'
+HEADER_SIZE = 128
+RECORD_HEAD_SIZE = 40
+
+# Header fields as indices into the header viewed as 64-bit words
+CAPACITY, PRODUCER_PID, PRODUCER_STATE, WRITE_CURSOR, READ_CURSOR, CONSUMER_PID, OVERWRITTEN = 2, 4, 5, 6, 7, 8, 9
+FINISHED = 2
+
+CELLS_PER_PLANE = 64
+CELLS_PER_SIDE = 8
+PLANE_SIZE_CM = 50.
+CELL_PITCH_CM = PLANE_SIZE_CM / CELLS_PER_SIDE
+
+
+def record_dtype(n_cells, record_size):
+    return np.dtype({'names': ['sequence', 'eventID', 'xTrue', 'yTrue', 'nMuonSteps', 'light'],
+                     'formats': ['<u8', '<i8', '<f8', '<f8', '<i4', ('<f4', (n_cells,))],
+                     'offsets': [0, 8, 16, 24, 32, RECORD_HEAD_SIZE],
+                     'itemsize': record_size})
+
+
+def plane_fractions(light, plane=0):
+    """Fractional light per cell of one plane: the Cell_0..Cell_63 features of Convert_To_CSV.py."""
+    cells = light[:, plane * CELLS_PER_PLANE:(plane + 1) * CELLS_PER_PLANE].astype(np.float64)
+    total = cells.sum(axis=1, keepdims=True)
+    return np.divide(cells, total, out=np.zeros_like(cells), where=total > 0)
+
+
+def centroid_model(features):
+    """Baseline: light-weighted centroid of the cell centres, in cm."""
+    centres = (np.arange(CELLS_PER_SIDE) + 0.5) * CELL_PITCH_CM - PLANE_SIZE_CM / 2
+    grid = features.reshape(-1, CELLS_PER_SIDE, CELLS_PER_SIDE)  # [event, y index, x index]
+    x = (grid.sum(axis=1) * centres).sum(axis=1)
+    y = (grid.sum(axis=2) * centres).sum(axis=1)
+    return np.stack([x, y], axis=1)
+
+
+def load_model(spec):
+    """'module:function' taking an (N, 64) feature array and returning (N, 2) positions in cm."""
+    if spec is None:
+        return centroid_model
+    module_name, function_name = spec.split(':')
+    return getattr(importlib.import_module(module_name), function_name)
+
+
+def attach(name, timeout):
+    """Map the segment, waiting for the producer to create it."""
+    path = '/dev/shm/' + name.lstrip('/')
+    deadline = time.monotonic() + timeout
+    while not os.path.exists(path):
+        if time.monotonic() > deadline:
+            raise TimeoutError(f"no stream {name} after {timeout} s")
+        time.sleep(0.1)
+    with open(path, 'r+b') as file:
+        buffer = mmap.mmap(file.fileno(), 0)
+    if buffer[:8] != MAGIC:
+        raise ValueError(f"{name} is not a cosmicMuonTomography stream")
+    return buffer
+
+
+class Stream:
+    """Zero-copy numpy views of the ring; records are copied out only once validated."""
+
+    def __init__(self, buffer):
+        self.buffer = buffer
+        self.header = np.frombuffer(buffer, dtype='<u8', count=HEADER_SIZE // 8)
+        version, record_size = np.frombuffer(buffer, dtype='<u4', count=2, offset=8)
+        n_cells, blocking = np.frombuffer(buffer, dtype='<u4', count=2, offset=24)
+        n_cells = int(n_cells)
+        if version != 1:
+            raise ValueError(f"unsupported stream version {version}")
+        self.capacity = int(self.header[CAPACITY])
+        self.records = np.frombuffer(buffer, dtype=record_dtype(n_cells, int(record_size)),
+                                     count=self.capacity, offset=HEADER_SIZE)
+        # Producers wait for this consumer; the write cursor may then run ahead by the
+        # records they have claimed without overwriting anything
+        self.blocking = bool(blocking)
+        self.next = int(self.header[READ_CURSOR])
+        self.lost = 0
+        self.header[CONSUMER_PID] = os.getpid()
+
+    def close(self):
+        self.header[CONSUMER_PID] = 0
+        del self.header, self.records
+        self.buffer.close()
+
+    def producer_alive(self):
+        """The producer may die without marking the stream finished (killed, aborted)."""
+        try:
+            os.kill(int(self.header[PRODUCER_PID]), 0)
+        except ProcessLookupError:
+            return False
+        except PermissionError:
+            pass
+        return True
+
+    def finished(self, follow=False):
+        """All records of the run read (with follow: of the whole job, i.e. until the producer exits)."""
+        if self.next < int(self.header[WRITE_CURSOR]):
+            return False
+        return (self.header[PRODUCER_STATE] == FINISHED and not follow) or not self.producer_alive()
+
+    def abandon(self):
+        """The producer is gone: records it claimed but never completed are lost."""
+        self.lost += max(0, int(self.header[WRITE_CURSOR]) - self.next)
+        self.next = int(self.header[WRITE_CURSOR])
+
+    def read_batch(self, max_records):
+        """Up to max_records complete records in order (an empty array when none is ready)."""
+        written = int(self.header[WRITE_CURSOR])
+        if not self.blocking and written - self.next > self.capacity:
+            # Lapped by the producers: skip what was overwritten
+            self.lost += written - self.capacity - self.next
+            self.next = written - self.capacity
+
+        numbers = np.arange(self.next, min(written, self.next + max_records), dtype=np.uint64)
+        slots = (numbers % self.capacity).astype(np.int64)
+        # Complete, or already overwritten by a later record (lost); stop at the
+        # first record still being written
+        done = self.records['sequence'][slots] >= 2 * numbers + 2
+        ready = len(numbers) if done.all() else int(np.argmin(done))
+        numbers, slots = numbers[:ready], slots[:ready]
+
+        batch = self.records[slots]  # copy out, then check nothing was overwritten meanwhile
+        valid = self.records['sequence'][slots] == 2 * numbers + 2
+        self.lost += int((~valid).sum())
+
+        self.next += ready
+        self.header[READ_CURSOR] = self.next
+        return batch[valid]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Reference consumer of /tomography/stream/: runs a "
+                                                 "position model on every streamed event and compares "
+                                                 "it with the truth muon position.")
+    parser.add_argument("name", nargs="?", default="/tomography_stream")
+    parser.add_argument("--model", default=None, help="module:function, default: light centroid")
+    parser.add_argument("--plane", type=int, default=0, help="plane whose cells are the model input")
+    parser.add_argument("--batch", type=int, default=1024)
+    parser.add_argument("--timeout", type=float, default=60., help="seconds to wait for the producer")
+    parser.add_argument("--follow", action="store_true",
+                        help="keep reading the following runs until the producer exits")
+    args = parser.parse_args()
+
+    model = load_model(args.model)
+    stream = Stream(attach(args.name, args.timeout))
+    print(f"Attached to {args.name}: {stream.capacity} records, starting at record {stream.next}")
+
+    n_events, residuals = 0, []
+    start = last_report = time.monotonic()
+    try:
+        while not stream.finished(args.follow):
+            batch = stream.read_batch(args.batch)
+            if len(batch) == 0:
+                if not stream.producer_alive():
+                    stream.abandon()
+                    print("Producer exited without finishing the stream")
+                    break
+                time.sleep(0.001)
+                continue
+
+            hit = batch['nMuonSteps'] > 0
+            predicted = model(plane_fractions(batch['light'][hit], args.plane))
+            truth = np.stack([batch['xTrue'][hit], batch['yTrue'][hit]], axis=1)
+            residuals.append(predicted - truth)
+            n_events += len(batch)
+
+            now = time.monotonic()
+            if now - last_report > 5.:
+                print(f"{n_events} events, {n_events / (now - start):.0f} events/s, "
+                      f"{stream.lost} lost, {int(stream.header[OVERWRITTEN])} overwritten by the producer")
+                last_report = now
+    finally:
+        stream.close()
+
+    elapsed = time.monotonic() - start
+    print(f"Stream finished: {n_events} events in {elapsed:.1f} s, {stream.lost} lost")
+    if residuals:
+        residuals = np.concatenate(residuals)
+        print(f"Residual (predicted - true) over {len(residuals)} events with a muon: "
+              f"mean x {residuals[:, 0].mean():+.2f} cm, y {residuals[:, 1].mean():+.2f} cm; "
+              f"RMS x {residuals[:, 0].std():.2f} cm, y {residuals[:, 1].std():.2f} cm")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -7,8 +7,14 @@
 #include "FTFP_BERT.hh"
 #include "G4OpticalPhysics.hh" 
 
+// The headless batch target (TOMOGRAPHY_HEADLESS) compiles out visualization
+// and the interactive UI session
+#ifndef TOMOGRAPHY_HEADLESS
 #include "G4VisExecutive.hh"
 #include "G4UIExecutive.hh"
+#else
+class G4UIExecutive;
+#endif
 
 #include "Randomize.hh"
 
@@ -17,19 +23,30 @@ int main(int argc, char** argv)
 {
     // Detect interactive mode (if no arguments) and define UI session
     G4UIExecutive* ui = nullptr;
+#ifndef TOMOGRAPHY_HEADLESS
     if (argc == 1) {
         ui = new G4UIExecutive(argc, argv);
     }
+#else
+    if (argc == 1) {
+        G4cerr << "Usage: " << argv[0] << " <macro>" << G4endl
+               << "This build has no visualization or interactive UI; a macro file is required." << G4endl;
+        return 1;
+    }
+#endif
 
-    // Optionally: choose a different Random engine...
+    // Random engine type (worker engines are clones). Each event is reseeded from
+    // (run seed, EventID) by EventSeeder, see /tomography/random/
     G4Random::setTheEngine(new CLHEP::RanecuEngine);
 
     // Use G4SteppingVerboseWithUnits
     G4int precision = 4;
     G4SteppingVerbose::UseBestUnit(precision);
 
-    // Construct the default run manager
-    auto* runManager = G4RunManagerFactory::CreateRunManager(G4RunManagerType::Serial);
+    // Construct the default run manager (multi-threaded when Geant4 supports it;
+    // set the number of threads with /run/numberOfThreads). G4RUN_MANAGER_TYPE=SubEvt
+    // selects sub-event parallel mode (Geant4 >= 11.2), see StackingAction
+    auto* runManager = G4RunManagerFactory::CreateRunManager(G4RunManagerType::Default);
 
     // Set mandatory initialization classes
     runManager->SetUserInitialization(new DetectorConstruction());
@@ -44,11 +61,13 @@ int main(int argc, char** argv)
     // User action initialization
     runManager->SetUserInitialization(new ActionInitialization());
 
+#ifndef TOMOGRAPHY_HEADLESS
     // Initialize visualization
     G4VisManager* visManager = new G4VisExecutive;
     // G4VisExecutive can take a verbosity argument - see /vis/verbose guidance.
     // G4VisManager* visManager = new G4VisExecutive("Quiet");
     visManager->Initialize();
+#endif
 
 
     // Get the pointer to the User Interface manager
@@ -60,7 +79,9 @@ int main(int argc, char** argv)
         G4String command = "/control/execute ";
         G4String fileName = argv[1];
         UImanager->ApplyCommand(command + fileName);
-    } else {
+    }
+#ifndef TOMOGRAPHY_HEADLESS
+    else {
         // interactive mode
         G4int result = UImanager->ApplyCommand("/control/execute init_vis.mac");
         if (result != 0) {
@@ -109,9 +130,12 @@ int main(int argc, char** argv)
         ui->SessionStart();
         delete ui;
     }
+#endif
 
     // Job termination
+#ifndef TOMOGRAPHY_HEADLESS
     delete visManager;
+#endif
     delete runManager;
 
     return 0;
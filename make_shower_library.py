@@ -0,0 +1,116 @@
+import argparse
+import shutil
+import struct
+import sys
+import tempfile
+
+import numpy as np
+import pandas as pd
+
+# Binary layout read by ShowerLibrary (see ShowerLibrary.hh)
+MAGIC = b'CMTSHLB1'
+VERSION = 1
+HEADER = struct.Struct('<8sIIQQQQ16x')
+PARTICLE_DTYPE = np.dtype([('pdg', '<i4'),
+                           ('x', '<f4'), ('y', '<f4'), ('z', '<f4'),
+                           ('px', '<f4'), ('py', '<f4'), ('pz', '<f4'),
+                           ('t', '<f4')])
+COLUMNS = ['event', 'pdg', 'x', 'y', 'z', 'px', 'py', 'pz', 't']
+
+
+class LibraryWriter:
+    """
+    Streams particles, grouped by event, into a shower library. Particles go
+    straight to the output file and event start indices to a temporary file,
+    so memory use does not grow with the library size.
+    """
+
+    def __init__(self, filename):
+        self.out = open(filename, 'wb')
+        self.table = tempfile.TemporaryFile()
+        self.out.write(b'\0' * HEADER.size)
+        self.n_events = 0
+        self.n_particles = 0
+        self.last_event = None
+
+    def append(self, events, particles):
+        """Append particles (PARTICLE_DTYPE) belonging to the given, non-decreasing event labels."""
+        if len(events) == 0:
+            return
+        if np.any(events[1:] < events[:-1]) or (self.last_event is not None and events[0] < self.last_event):
+            raise ValueError("particles must be sorted by event")
+        new_event = np.empty(len(events), dtype=bool)
+        new_event[0] = events[0] != self.last_event
+        new_event[1:] = events[1:] != events[:-1]
+        starts = np.flatnonzero(new_event)
+
+        (self.n_particles + starts).astype('<u8').tofile(self.table)
+        particles.astype(PARTICLE_DTYPE, copy=False).tofile(self.out)
+        self.n_events += len(starts)
+        self.n_particles += len(particles)
+        self.last_event = events[-1]
+
+    def close(self):
+        np.array([self.n_particles], dtype='<u8').tofile(self.table)
+        table_offset = HEADER.size + self.n_particles * PARTICLE_DTYPE.itemsize
+        self.table.seek(0)
+        shutil.copyfileobj(self.table, self.out)
+        self.out.seek(0)
+        self.out.write(HEADER.pack(MAGIC, VERSION, PARTICLE_DTYPE.itemsize, self.n_events,
+                                   self.n_particles, HEADER.size, table_offset))
+        self.out.close()
+        self.table.close()
+        return self.n_events, self.n_particles
+
+
+def from_csv(csv_filename, writer, chunk_rows):
+    """CSV with columns event, pdg, x, y, z [mm], px, py, pz [MeV], t [ns], sorted by event."""
+    for chunk in pd.read_csv(csv_filename, usecols=COLUMNS, chunksize=chunk_rows):
+        particles = np.empty(len(chunk), dtype=PARTICLE_DTYPE)
+        for column in PARTICLE_DTYPE.names:
+            particles[column] = chunk[column].to_numpy()
+        writer.append(chunk['event'].to_numpy(), particles)
+
+
+def synthetic(n_events, writer, chunk_rows, seed):
+    """Single downward muons like the built-in gun, for testing replay against gun mode."""
+    rng = np.random.default_rng(seed)
+    for first in range(0, n_events, chunk_rows):
+        n = min(chunk_rows, n_events - first)
+        theta = np.minimum(rng.normal(0., 0.1, n), 0.5)
+        phi = rng.uniform(0., 2. * np.pi, n)
+        momentum = np.sqrt(4000.**2 + 2. * 4000. * 105.658)  # 4 GeV kinetic energy
+        particles = np.zeros(n, dtype=PARTICLE_DTYPE)
+        particles['pdg'] = 13
+        particles['x'] = rng.uniform(-75., 75., n)
+        particles['y'] = rng.uniform(-75., 75., n)
+        particles['z'] = 500.
+        particles['px'] = momentum * np.sin(theta) * np.cos(phi)
+        particles['py'] = momentum * np.sin(theta) * np.sin(phi)
+        particles['pz'] = -momentum * np.cos(theta)
+        writer.append(np.arange(first, first + n), particles)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Write a shower library for /tomography/gun/mode replay.")
+    parser.add_argument("output", help="library file to write")
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--csv", help="particle table: " + ", ".join(COLUMNS))
+    source.add_argument("--synthetic", type=int, metavar="N", help="generate N single-muon events")
+    parser.add_argument("--chunk-rows", type=int, default=1000000)
+    parser.add_argument("--seed", type=int, default=12345)
+    args = parser.parse_args()
+
+    writer = LibraryWriter(args.output)
+    if args.csv:
+        from_csv(args.csv, writer, args.chunk_rows)
+    else:
+        synthetic(args.synthetic, writer, args.chunk_rows, args.seed)
+    n_events, n_particles = writer.close()
+    print(f"Wrote {args.output}: {n_events} events, {n_particles} particles")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
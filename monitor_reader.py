@@ -0,0 +1,108 @@
+import argparse
+import glob
+import mmap
+import os
+import struct
+import sys
+import time
+
+# Layout written by LiveMonitor (see LiveMonitor.hh)
+MAGIC = b'CMTMON01'
+HEADER = struct.Struct('=8sIIqqqqQQQ56x')
+SLOT = struct.Struct('=qQQQQqQQ')
+
+
+def find_segments():
+    """Segments of running (or crashed) jobs; /dev/shm is where Linux keeps POSIX shared memory."""
+    return sorted('/' + os.path.basename(path) for path in glob.glob('/dev/shm/tomography_monitor_*'))
+
+
+def read_snapshot(buffer):
+    magic, version, n_slots, pid, run_id, run_active, events_to_process, events_at_run_start, \
+        rss_bytes, _ = HEADER.unpack_from(buffer, 0)
+    if magic != MAGIC or version != 1:
+        raise ValueError("not a cosmicMuonTomography monitor segment")
+    slots = {}
+    for index in range(n_slots):
+        active, events, steps, output_bytes, queue_depth, last_event, heartbeat_ns, _ = \
+            SLOT.unpack_from(buffer, HEADER.size + index * SLOT.size)
+        if active:
+            slots[index] = dict(events=events, steps=steps, output_bytes=output_bytes,
+                                queue_depth=queue_depth, last_event=last_event, heartbeat=heartbeat_ns * 1e-9)
+    return dict(time=time.time(), pid=pid, run_id=run_id, run_active=bool(run_active),
+                events_to_process=events_to_process, events_at_run_start=events_at_run_start,
+                rss_mb=rss_bytes / 1024**2, slots=slots)
+
+
+def thread_name(index):
+    return 'master' if index == 0 else f'worker {index - 1}'
+
+
+def display(previous, current, stall_seconds):
+    """One report; rates are taken over the interval since the previous snapshot."""
+    interval = max(current['time'] - previous['time'], 1e-9)
+
+    def rate(key, index=None):
+        slots = [index] if index is not None else current['slots'].keys()
+        return sum(current['slots'][i][key] - previous['slots'].get(i, {}).get(key, 0) for i in slots) / interval
+
+    total_events = sum(slot['events'] for slot in current['slots'].values())
+    done = total_events - current['events_at_run_start']
+    alive = os.path.exists(f"/proc/{current['pid']}")
+    state = 'running' if current['run_active'] else 'idle'
+    if not alive:
+        state = 'process gone'
+
+    lines = [f"pid {current['pid']}  run {current['run_id']} ({state})  "
+             f"events {done}/{current['events_to_process']}  "
+             f"{rate('events'):.1f} events/s  {rate('steps') / 1e6:.2f} Msteps/s  "
+             f"output {rate('output_bytes') / 1024**2:.2f} MB/s  RSS {current['rss_mb']:.0f} MB",
+             f"{'thread':>10s} {'events':>10s} {'events/s':>9s} {'Msteps/s':>9s} {'queue':>6s} "
+             f"{'last event':>10s} {'heartbeat':>10s}"]
+    for index, slot in sorted(current['slots'].items()):
+        age = current['time'] - slot['heartbeat']
+        flag = '  STALLED' if current['run_active'] and alive and age > stall_seconds else ''
+        lines.append(f"{thread_name(index):>10s} {slot['events']:10d} {rate('events', index):9.1f} "
+                     f"{rate('steps', index) / 1e6:9.2f} {slot['queue_depth']:6d} {slot['last_event']:10d} "
+                     f"{age:9.1f}s{flag}")
+    return '\n'.join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Live view of a running cosmicMuonTomography job "
+                                                 "(enable with /tomography/monitor/enable true).")
+    parser.add_argument("segment", nargs="?",
+                        help="shared-memory name printed by the job; default: the only one found")
+    parser.add_argument("--interval", type=float, default=2., help="seconds between updates")
+    parser.add_argument("--stall", type=float, default=60.,
+                        help="flag threads without an update for this many seconds")
+    parser.add_argument("--once", action="store_true", help="print one report and exit")
+    args = parser.parse_args()
+
+    segment = args.segment
+    if segment is None:
+        segments = find_segments()
+        if len(segments) != 1:
+            print("Found segments: " + (", ".join(segments) or "none") + "; pass one explicitly.")
+            return 1
+        segment = segments[0]
+
+    with open('/dev/shm/' + segment.lstrip('/'), 'rb') as file, \
+            mmap.mmap(file.fileno(), 0, access=mmap.ACCESS_READ) as buffer:
+        previous = read_snapshot(buffer)
+        while True:
+            time.sleep(args.interval)
+            current = read_snapshot(buffer)
+            if not args.once:
+                print('\033[2J\033[H', end='')
+            print(display(previous, current, args.stall), flush=True)
+            if args.once:
+                return 0
+            previous = current
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main())
+    except KeyboardInterrupt:
+        sys.exit(0)